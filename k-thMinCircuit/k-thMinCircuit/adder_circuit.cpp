@@ -3,19 +3,16 @@
 adder_circuit::adder_circuit()
 	: circuit(3, 2)
 {
-	gate* gand[2], * gxor[2], * gor;
-	gate::init(gand, 2, gate::AND);
-	gate::init(gxor, 2, gate::XOR);
-	gor = new gate(gate::OR);
+	gate* gxor[2], * gmaj;
+	new_gates(gxor, 2, gate::XOR);
+	gmaj = new_gate(gate::MAJ);
 
 	gxor[0]->concat(in[0], in[1]);
-	gand[0]->concat(in[0], in[1]);
 	gxor[1]->concat(gxor[0], in[2]);
-	gand[1]->concat(gxor[0], in[2]);
-	gor->concat(gand[0], gand[1]);
+	gmaj->concat(in[0], in[1], in[2]);
 
 	out[0] = gxor[1];
-	out[1] = gor;
+	out[1] = gmaj;
 }
 
 void demo_adder() {
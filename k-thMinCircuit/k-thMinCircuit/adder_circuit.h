@@ -5,7 +5,7 @@
 * This is the implementation of full adder, with carry bit.
 * It takes as input two bits, and output two bits.
 * input[0] will be XOR of the three inputs, input[1] will be AND of then
-* ADDER = two XOR gates + two AND gates + one OR gate
+* ADDER = two XOR gates + one MAJ gate (the carry is the majority of the three inputs)
 * 
 *                |---------|
 * input[0] ---->>|         |------->> output[0] (XOR)
@@ -0,0 +1,301 @@
+/*
+* The benchmark executable (kmc_bench, see CMakeLists.txt): for every generator over a parameter sweep, it measures
+*     build_s           the time to construct the circuit
+*     compile_s         the time to compile it into a compiled_circuit (0 for generators that build one directly)
+*     gates, size, depth, compiled_bytes    as in circuit_stats (size and depth are -1 for kmin_hier)
+*     base_rss_kb       the peak resident set before construction: the fixed footprint of the process
+*     peak_rss_kb       the peak resident set of the whole case
+*     bytes_per_gate    (peak_rss - base_rss) / gates: the memory taken by the circuit, per gate
+*     vectors_per_s     eval_batch throughput, in input vectors; gates_per_s = vectors_per_s * gates
+* and prints one row per case, as CSV (default) or JSON.
+*
+* Each case runs in a child process (POSIX), so the peak RSS is that of the case alone and a case that runs out of
+* memory only loses its own row. Elsewhere the cases run in this process and the peak RSS is not measured (-1).
+*
+*     kmc_bench [--format csv|json] [--output FILE] [--only GENERATOR] [--quick] [--seconds S]
+*
+* --quick stops the sweep at n = 256; --seconds is the minimum time spent evaluating each case (default 0.2).
+*/
+#include "adder_circuit.h"
+#include "bitadder_circuit.h"
+#include "int_adder.h"
+#include "prefix_adder.h"
+#include "compare_circuit.h"
+#include "selector.h"
+#include "kmin_circuit.h"
+#include "netlist_builder.h"
+#include "circuit_stats.h"
+#include "simd_kernel.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+struct _case {
+	std::string generator;
+	int n, l;
+};
+
+/*
+* What a case measures; plain data, so that it can be sent back from the child process as is.
+*/
+struct _measure {
+	long long gates;
+	int size, depth;
+	double build_s, compile_s, vectors_per_s;
+	long long compiled_bytes, base_rss_kb, peak_rss_kb;
+	bool ok;
+};
+
+static double _since(std::chrono::steady_clock::time_point t) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+static std::vector<_case> _sweep(bool quick, const std::string& only) {
+	std::vector<_case> ret;
+	std::vector<int> ns{ 16, 64, 256, 1024, 4096 }, ls{ 8, 32, 128 };
+	if (quick) ns.resize(3);
+	auto add = [&](const std::string& g, int n, int l) {
+		if (only.empty() || only == g) ret.push_back({ g, n, l });
+	};
+	add("adder", 1, 0);
+	for (const char* g : { "bitadder", "csa_bitadder", "int_adder", "exint_adder", "prefix_int_adder", "compare", "less",
+		"tree_compare", "tree_less", "selector" }) {
+		for (int n : ns) add(g, n, 0);
+	}
+	for (const char* g : { "kmin_circuit", "build_kmin", "kmin_hier" }) {
+		for (int n : ns) {
+			for (int l : ls) add(g, n, l);
+		}
+	}
+	return ret;
+}
+
+/*
+* The peak resident set of this process so far, in KB; -1 where it is not measured.
+*/
+static long long _peak_rss_kb() {
+#if defined(_WIN32)
+	return -1;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024; // bytes there
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static _measure _run(const _case& c, double seconds) {
+	_measure m;
+	memset(&m, 0, sizeof(m));
+	m.size = m.depth = -1;
+	m.base_rss_kb = _peak_rss_kb();
+	compiled_circuit CC;
+	std::unique_ptr<kmin_hier> H;
+	const std::string& g(c.generator);
+	auto t0 = std::chrono::steady_clock::now();
+	auto compile = [&](const circuit& C) {
+		m.build_s = _since(t0);
+		auto t1 = std::chrono::steady_clock::now();
+		CC = compiled_circuit(C);
+		m.compile_s = _since(t1);
+	};
+	if (g == "adder") compile(adder_circuit());
+	else if (g == "bitadder") compile(bitadder_circuit(c.n));
+	else if (g == "csa_bitadder") compile(csa_bitadder_circuit(c.n));
+	else if (g == "int_adder") compile(int_adder(c.n));
+	else if (g == "exint_adder") compile(exint_adder(c.n));
+	else if (g == "prefix_int_adder") compile(prefix_int_adder(c.n));
+	else if (g == "compare") compile(compare_circuit(c.n));
+	else if (g == "less") compile(less_circuit(c.n));
+	else if (g == "tree_compare") compile(tree_compare_circuit(c.n));
+	else if (g == "tree_less") compile(tree_less_circuit(c.n));
+	else if (g == "selector") compile(selector(c.n));
+	else if (g == "kmin_circuit") compile(kmin_circuit(c.n, c.l));
+	else if (g == "build_kmin") {
+		CC = build_kmin(c.n, c.l);
+		m.build_s = _since(t0);
+	} else if (g == "kmin_hier") {
+		H.reset(new kmin_hier(c.n, c.l));
+		m.build_s = _since(t0);
+	} else {
+		throw "Unknown generator.";
+	}
+
+	int fanin(H ? H->fanin() : CC.fanin()), fanout(H ? H->fanout() : CC.fanout());
+	if (H) {
+		m.gates = H->gate_count();
+		m.compiled_bytes = H->bytes();
+	} else {
+		circuit_stats S(CC);
+		m.gates = CC.gate_count();
+		m.size = CC.size();
+		m.depth = CC.depth();
+		m.compiled_bytes = S.compiled_bytes;
+	}
+	const int words(64);
+	std::vector<uint64_t> input(size_t(fanin) * words), output(size_t(fanout) * words);
+	for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	long long reps(0);
+	auto t1 = std::chrono::steady_clock::now();
+	double sec(0);
+	do {
+		if (H) H->eval_batch(input.data(), output.data(), words);
+		else CC.eval_batch(input.data(), output.data(), words);
+		++reps;
+	} while ((sec = _since(t1)) < seconds);
+	m.vectors_per_s = reps * words * 64 / sec;
+	m.peak_rss_kb = _peak_rss_kb();
+	m.ok = true;
+	return m;
+}
+
+/*
+* Run the case in a child process; m.ok is false if it failed (e.g. out of memory).
+*/
+static _measure _run_isolated(const _case& c, double seconds) {
+#if defined(_WIN32)
+	try {
+		return _run(c, seconds);
+	} catch (...) {
+		_measure m;
+		memset(&m, 0, sizeof(m));
+		return m;
+	}
+#else
+	_measure m;
+	memset(&m, 0, sizeof(m));
+	int fd[2];
+	if (pipe(fd) != 0) throw "pipe failed.";
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) throw "fork failed.";
+	if (pid == 0) {
+		close(fd[0]);
+		try {
+			// A tiny case first, so that the pages every case touches (code, heap, the SIMD kernels) are in
+			// base_rss_kb, and the growth left is that of the circuit.
+			_run(_case{ "adder", 1, 0 }, 0);
+			m = _run(c, seconds);
+		} catch (...) {
+			m.ok = false;
+		}
+		ssize_t w = write(fd[1], &m, sizeof(m));
+		_exit(w == sizeof(m) ? 0 : 1);
+	}
+	close(fd[1]);
+	size_t got(0);
+	while (got != sizeof(m)) {
+		ssize_t r = read(fd[0], (char*)&m + got, sizeof(m) - got);
+		if (r <= 0) break;
+		got += r;
+	}
+	close(fd[0]);
+	int status;
+	waitpid(pid, &status, 0);
+	if (got != sizeof(m)) m.ok = false;
+	return m;
+#endif
+}
+
+static const char* _columns[] = { "generator", "n", "l", "gates", "size", "depth", "build_s", "compile_s", "compiled_bytes",
+	"base_rss_kb", "peak_rss_kb", "bytes_per_gate", "vectors_per_s", "gates_per_s" };
+
+static std::vector<std::string> _row(const _case& c, const _measure& m) {
+	auto str = [](double v) {
+		std::ostringstream s;
+		s << v;
+		return s.str();
+	};
+	using std::to_string;
+	double bytes_per_gate(m.peak_rss_kb < 0 ? -1 : (m.peak_rss_kb - m.base_rss_kb) * 1024.0 / m.gates);
+	return { c.generator, to_string(c.n), to_string(c.l), to_string(m.gates), to_string(m.size), to_string(m.depth),
+		str(m.build_s), str(m.compile_s), to_string(m.compiled_bytes), to_string(m.base_rss_kb),
+		to_string(m.peak_rss_kb), str(bytes_per_gate),
+		str(m.vectors_per_s), str(m.vectors_per_s * m.gates) };
+}
+
+int main(int argc, char* argv[]) {
+	std::string format("csv"), path, only;
+	bool quick(false);
+	double seconds(0.2);
+	for (int i(1); i != argc; ++i) {
+		std::string a(argv[i]);
+		if (a == "--quick") quick = true;
+		else if (i + 1 == argc) a.clear();
+		else if (a == "--format") format = argv[++i];
+		else if (a == "--output") path = argv[++i];
+		else if (a == "--only") only = argv[++i];
+		else if (a == "--seconds") seconds = atof(argv[++i]);
+		else a.clear();
+		if (a.empty() || (format != "csv" && format != "json")) {
+			std::cerr << "usage: kmc_bench [--format csv|json] [--output FILE] [--only GENERATOR] [--quick] [--seconds S]" << std::endl;
+			return 1;
+		}
+	}
+	std::ofstream file;
+	if (!path.empty()) {
+		file.open(path);
+		if (!file) {
+			std::cerr << "kmc_bench: cannot open " << path << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out(path.empty() ? std::cout : file);
+	auto cases = _sweep(quick, only);
+	if (cases.empty()) {
+		std::cerr << "kmc_bench: unknown generator " << only << std::endl;
+		return 1;
+	}
+	const int ncol(sizeof(_columns) / sizeof(_columns[0]));
+	if (format == "csv") {
+		for (int j(0); j != ncol; ++j) out << (j ? "," : "") << _columns[j];
+		out << std::endl;
+	} else {
+		out << "{\"simd\": \"" << simd_name(detect_simd()) << "\", \"results\": [";
+	}
+	bool first(true);
+	for (const _case& c : cases) {
+		_measure m;
+		try {
+			m = _run_isolated(c, seconds);
+		} catch (const char* e) {
+			std::cerr << "kmc_bench: " << e << std::endl;
+			return 1;
+		}
+		if (!m.ok) {
+			std::cerr << "kmc_bench: " << c.generator << "(" << c.n << ", " << c.l << ") failed" << std::endl;
+			continue;
+		}
+		auto row = _row(c, m);
+		if (format == "csv") {
+			for (int j(0); j != ncol; ++j) out << (j ? "," : "") << row[j];
+			out << std::endl;
+		} else {
+			out << (first ? "\n" : ",\n") << "  {";
+			for (int j(0); j != ncol; ++j) {
+				out << (j ? ", " : "") << "\"" << _columns[j] << "\": ";
+				if (j == 0) out << "\"" << row[j] << "\"";
+				else out << row[j];
+			}
+			out << "}" << std::flush;
+		}
+		first = false;
+	}
+	if (format == "json") out << "\n]}" << std::endl;
+	return 0;
+}
@@ -1,4 +1,9 @@
 #include "bitadder_circuit.h"
+#include "compiled_circuit.h"
+#include "kmin_circuit.h"
+
+#include <algorithm>
+#include <queue>
 
 /*
 * This function computes the number of bits needed to represent n in binary.
@@ -18,7 +23,7 @@ bitadder_circuit::bitadder_circuit(int n)
 	if (n == 1) throw "Cannot create a vacuous bitadder.";
 	if (n == 2) {
 		// do it by hand.
-		gate* gand(new gate(gate::AND)), * gxor(new gate(gate::XOR));
+		gate* gand(new_gate(gate::AND)), * gxor(new_gate(gate::XOR));
 		gand->concat(in[0], in[1]);
 		gxor->concat(in[0], in[1]);
 		out[0] = gxor;
@@ -31,7 +36,7 @@ bitadder_circuit::bitadder_circuit(int n)
 		for (int i(0); i != 3; ++i) in[i] = C.in[i];
 		for (int i(0); i != 2; ++i) out[i] = C.out[i];
 
-		C.moderate_clear();
+		adopt(C);
 		// this prevents ~circuit from destroying the above gates.
 		return;
 	}
@@ -41,7 +46,7 @@ bitadder_circuit::bitadder_circuit(int n)
 	// Yet since n >= 4, C1 has at least two bits.
 
 	// First, create a half adder manually
-	gate *gxor = new gate(gate::XOR), *gand = new gate(gate::AND);
+	gate *gxor = new_gate(gate::XOR), *gand = new_gate(gate::AND);
 	gxor->concat(C1.out[0], C2.out[0]);
 	gand->concat(C1.out[0], C2.out[0]);
 	out[0] = gxor;
@@ -57,10 +62,10 @@ bitadder_circuit::bitadder_circuit(int n)
 			adder.in[2]->concat(carry);
 			out[i] = adder.out[0];
 			carry = adder.out[1];
-			adder.moderate_clear();
+			adopt(adder);
 		} else {
 			// construct half adder
-			gate* gxor = new gate(gate::XOR), * gand = new gate(gate::AND);
+			gate* gxor = new_gate(gate::XOR), * gand = new_gate(gate::AND);
 			gxor->concat(carry, C2.out[i]);
 			gand->concat(carry, C2.out[i]);
 			out[i] = gxor;
@@ -80,8 +85,81 @@ bitadder_circuit::bitadder_circuit(int n)
 	for (int j(0); j != C2.in.size(); ++ind, ++j) {
 		in[ind] = C2.in[j];
 	}
-	C1.moderate_clear();
-	C2.moderate_clear();
+	adopt(C1);
+	adopt(C2);
+}
+
+csa_bitadder_circuit::csa_bitadder_circuit(int n)
+	: circuit(n, _count_bits(n))
+{
+	if (n == 1) throw "Cannot create a vacuous bitadder.";
+	// A bit of a column: its depth (the longest path from the inputs), the order it was made in, and the gate.
+	// Ties in depth are broken by that order, so the wiring does not depend on where the gates are allocated.
+	struct bit {
+		int depth, seq;
+		gate* g;
+		bool operator>(const bit& b) const {
+			return depth != b.depth ? depth > b.depth : seq > b.seq;
+		}
+	};
+	typedef std::priority_queue<bit, std::vector<bit>, std::greater<bit>> column;
+	std::vector<column> col(out.size() + 1);
+	int seq(0);
+	auto push = [&](column& c, int depth, gate* g) {
+		c.push({ depth, seq++, g });
+	};
+	for (gate* g : in) push(col[0], 0, g);
+	auto pop = [](column& c) {
+		bit b = c.top();
+		c.pop();
+		return b;
+	};
+
+	// Reduce the columns from LSB to MSB, so that all carries into a column are known when it is reduced.
+	// The carry of column w goes into w + 1; the carry out of the top column is always 0, since the sum is at most n.
+	gate* carry(nullptr);
+	int carry_depth(0);
+	for (int w(0); w != out.size(); ++w) {
+		column& c(col[w]);
+		// Three-greedy: compress the three earliest bits, the latest one going to the last XOR of the full adder.
+		while (c.size() > 2) {
+			bit x(pop(c)), y(pop(c)), z(pop(c));
+			adder_circuit adder;
+			adder.in[0]->concat(x.g);
+			adder.in[1]->concat(y.g);
+			adder.in[2]->concat(z.g);
+			int d = std::max(y.depth + 1, z.depth);
+			push(c, d + 1, adder.out[0]);
+			push(col[w + 1], std::max(y.depth + 2, z.depth + 1) + 1, adder.out[1]);
+			adopt(adder);
+		}
+		// the carry-propagate adder, one column at a time
+		if (carry) push(c, carry_depth, carry);
+		carry = nullptr;
+		if (c.size() == 0) {
+			out[w] = constant(false);
+		} else if (c.size() == 1) {
+			out[w] = c.top().g;
+		} else if (c.size() == 2) {
+			bit x(pop(c)), y(pop(c));
+			gate* gxor(new_gate(gate::XOR)), * gand(new_gate(gate::AND));
+			gxor->concat(x.g, y.g);
+			gand->concat(x.g, y.g);
+			out[w] = gxor;
+			carry = gand;
+			carry_depth = y.depth + 1;
+		} else {
+			bit x(pop(c)), y(pop(c)), z(pop(c));
+			adder_circuit adder;
+			adder.in[0]->concat(x.g);
+			adder.in[1]->concat(y.g);
+			adder.in[2]->concat(z.g);
+			out[w] = adder.out[0];
+			carry = adder.out[1];
+			carry_depth = std::max(y.depth + 2, z.depth + 1) + 1;
+			adopt(adder);
+		}
+	}
 }
 
 void demo_bitadder() {
@@ -112,3 +190,56 @@ void demo_bitadder() {
 		std::cout << "Bitadder passed." << std::endl;
 	}
 }
+
+void test_csa_bitadder() {
+	bool wrong(false);
+	std::cout << "n: F[k] | bitadder size, depth | csa_bitadder size, depth" << std::endl;
+	for (int k(2); k <= 10; ++k) {
+		int n = 1 << k;
+		bitadder_circuit B(n);
+		csa_bitadder_circuit C(n);
+		B.check();
+		C.check();
+		compiled_circuit CB(B), CC(C);
+		std::cout << n << ": " << 9 * (1 << (k - 1)) - 5 * k + 3 << " | " << B.size() << ", " << CB.depth()
+			<< " | " << C.size() << ", " << CC.depth() << std::endl;
+	}
+	for (int n : { 2, 3, 4, 5, 7, 9, 17, 33, 100, 257 }) {
+		csa_bitadder_circuit C(n);
+		C.check();
+		for (int _(0); _ != 20; ++_) {
+			std::vector<bool> vec(n);
+			int ans(0), v(0);
+			for (int j(0); j != n; ++j) vec[j] = rand() % 2, ans += vec[j];
+			auto output = C.eval(vec);
+			for (int j(output.size() - 1); j != -1; --j) v = ((v << 1) | output[j]);
+			if (v != ans || output.size() != _count_bits(n)) wrong = true;
+		}
+	}
+	{
+		const int n(100), l(32);
+		int logn(_count_bits(n));
+		kmin_options opt;
+		opt.popcount = kmin_options::CSA_POPCOUNT;
+		kmin_circuit R(n, l), C(n, l, opt);
+		C.check();
+		std::cout << "kmin_circuit(" << n << ", " << l << "): size " << R.size() << " -> " << C.size()
+			<< ", depth " << compiled_circuit(R).depth() << " -> " << compiled_circuit(C).depth() << std::endl;
+		std::vector<bool> val[n];
+		for (int _(0); _ != 200; ++_) {
+			std::vector<bool> input;
+			for (int i(0); i != n; ++i) {
+				val[i].clear();
+				for (int j(0); j != l; ++j) {
+					val[i].push_back(rand() % 2);
+					input.push_back(val[i].back());
+				}
+			}
+			int ik = rand() % n + 1;
+			for (int i(0); i != logn; ++i) input.push_back((ik >> (logn - i - 1)) & 1);
+			if (C.eval(input) != kmin(val, n, ik)) wrong = true;
+		}
+	}
+	if (wrong) std::cout << "test_csa_bitadder: wrong." << std::endl;
+	else std::cout << "test_csa_bitadder: passed." << std::endl;
+}
@@ -22,6 +22,27 @@ public:
     bitadder_circuit(int n);
 };
 
+/*
+* An alternative to bitadder_circuit, with the same interface: n bits in, $\lfloor \log n \rfloor + 1$ bits out, small endian.
+* 
+* It is a carry-save (Wallace / Dadda style) compressor tree: the bits are kept in columns by weight,
+* and full adders compress three bits of a column into one of the same column and one carry into the next,
+* until two bits are left; a column is then finished by the carry-propagate adder, from LSB to MSB.
+* Within a column, the three earliest bits are always compressed first (the "three-greedy" order).
+* 
+* It uses about n full adders (3 gates each: two XOR and a MAJ), against about 5n gates for bitadder_circuit,
+* e.g. 3059 against 5085 gates for n = 1024. The depth is about the same, at most one level more (27 against 26
+* for n = 1024): a full adder only reduces the bits by 3:2.
+*/
+class csa_bitadder_circuit :
+    public circuit
+{
+public:
+    csa_bitadder_circuit(int n);
+};
+
 int _count_bits(int n);
 
 void demo_bitadder();
+
+void test_csa_bitadder();
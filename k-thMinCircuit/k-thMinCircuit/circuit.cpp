@@ -1,84 +1,105 @@
 #include "circuit.h"
+#include "validator.h"
 
-circuit::circuit(const circuit& C) :
-	in(C.in),
-	out(C.out) {
-	std::map<gate*, const gate*> mapto;
-	std::map<const gate*, gate*> mapback;
-	std::queue<gate*> que;
-	/*
-	* Consider the new circuit is on the left, C on the right
-	*          mapto
-	*       ---------->
-	* this               C
-	*       <----------
-	*         mapback
-	*/
-
-	mapto[nullptr] = nullptr;
-	mapback[nullptr] = nullptr;
+#include <algorithm>
+#include <new>
+#include <unordered_map>
 
-	for (int i(0); i != in.size(); ++i) {
-		mapto[in[i]] = C.in[i];
-		mapback[C.in[i]] = in[i];
-		que.push(in[i]);
+circuit::circuit(const circuit& C)
+	: in(C.in.size(), nullptr), out(C.out.size(), nullptr) {
+	// mapback[g] is the copy of the gate g of C
+	std::unordered_map<const gate*, gate*> mapback;
+	mapback[nullptr] = nullptr;
+	for (int i(0); i != in.size(); ++i) in[i] = mapback[C.in[i]] = arena.create(gate::INPUT);
+	for (int v(0); v != 2; ++v) {
+		if (C.constants[v]) constants[v] = mapback[C.constants[v]] = arena.create(C.constants[v]->type);
 	}
-	while (!que.empty()) {
-		gate* now(que.front());
-		que.pop();
-		const gate* cor = mapto[now];
-		for (const gate* right : cor->output) {
-			gate* left(nullptr);
-			if (mapback.find(right) == mapback.end()) {
-				left = mapback[right] = new gate(right->type);
-				que.push(left);
-			} else {
-				left = mapback[right];
-			}
-			now->output.push_back(left);
+	std::vector<gate*> order(C.topo_order());
+	for (const gate* g : order) {
+		if (mapback.find(g) == mapback.end()) {
+			gate* copy = mapback[g] = arena.create(g->type);
+			copy->nm = g->nm;
 		}
 	}
+	// the wires, keeping the order of input[] and of the output vectors
+	for (const gate* g : order) {
+		gate* copy(mapback[g]);
+		for (int i(0); i != 3; ++i) copy->input[i] = mapback[g->input[i]];
+		for (const gate* o : g->output) copy->output.push_back(mapback[o]);
+	}
+	for (int i(0); i != out.size(); ++i) {
+		auto itr = mapback.find(C.out[i]);
+		if (itr == mapback.end()) throw "Output gate not reachable from input.";
+		out[i] = itr->second;
+	}
+}
+
+circuit::circuit(circuit&& C) noexcept
+	: in(std::move(C.in)), out(std::move(C.out)), arena(std::move(C.arena)), constants{ C.constants[0], C.constants[1] } {
+	C.in.clear();
+	C.out.clear();
+	C.constants[0] = C.constants[1] = nullptr;
+}
+
+circuit& circuit::operator=(circuit&& C) noexcept {
+	if (this != &C) {
+		clear();
+		in = std::move(C.in);
+		out = std::move(C.out);
+		arena = std::move(C.arena);
+		constants[0] = C.constants[0], constants[1] = C.constants[1];
+		C.in.clear();
+		C.out.clear();
+		C.constants[0] = C.constants[1] = nullptr;
+	}
+	return *this;
 }
 
 // Deconstruct all gates in the circuit.
 void circuit::clear() {
-	std::queue<gate*> que;
-	std::unordered_set<gate*> set;
-	set.insert(nullptr);
-	for (gate* g : in) {
-		que.push(g);
-		set.insert(g);
-	}
-	for (gate* g : out) {
-		que.push(g);
-		set.insert(g);
-	}
-	while (!que.empty()) {
-		gate* now(que.front());
-		que.pop();
-		for (gate* to : now->output) {
-			if (set.find(to) == set.end()) {
-				set.insert(to);
-				que.push(to);
-			}
-		}
-		for (int i(0); i != 2; ++i) {
-			if (set.find(now->input[i]) == set.end()) {
-				set.insert(now->input[i]);
-				que.push(now->input[i]);
-			}
-		}
-	}
-	for (gate* g : set) {
-		delete g;
-	}
+	arena.clear();
 	in.clear();
 	out.clear();
+	constants[0] = constants[1] = nullptr;
 }
 
 void circuit::moderate_clear() {
 	in.clear();
 	out.clear();
+	constants[0] = constants[1] = nullptr;
+}
+
+void circuit::adopt(circuit& C) {
+	for (int v(0); v != 2; ++v) {
+		if (C.constants[v] == nullptr) continue;
+		if (constants[v] == nullptr) constants[v] = C.constants[v];
+		else C.replace(C.constants[v], constants[v]);
+	}
+	arena.splice(C.arena);
+	C.moderate_clear();
+}
+
+gate* circuit::constant(bool v) {
+	if (constants[v] == nullptr) constants[v] = arena.create(v ? gate::ONE : gate::ZERO);
+	return constants[v];
+}
+
+std::vector<gate*> circuit::roots() const {
+	std::vector<gate*> ret(in);
+	for (gate* g : constants) {
+		if (g != nullptr) ret.push_back(g);
+	}
+	return ret;
+}
+
+gate* circuit::new_gate(gate::gate_type type) {
+	return arena.create(type);
+}
+
+void circuit::new_gates(gate* arr[], int sz, gate::gate_type type) {
+	for (int i(0); i != sz; ++i) {
+		arr[i] = arena.create(type);
+	}
 }
 
 circuit::~circuit() {
@@ -86,42 +107,9 @@ circuit::~circuit() {
 }
 
 void circuit::check() const {
-	std::queue<const gate*> que;
-	std::unordered_set<const gate*> set, setin, setout;
-	set.insert(nullptr);
-	for (const gate* g : out) {
-		setout.insert(g);
-	}
-	for (const gate* g : in) {
-		if (g->type != gate::INPUT) throw "Input gate is not of type INPUT.";
-		que.push(g);
-		set.insert(g);
-		setin.insert(g);
-	}
-	while (!que.empty()) {
-		const gate* now(que.front());
-		que.pop();
-		now->check();
-		for (const gate* g : now->output) {
-			if (set.find(g) == set.end()) {
-				set.insert(g);
-				que.push(g);
-			}
-		}
-		if (now->type != gate::INPUT) {
-			for (int i(0); i != 2; ++i) {
-				if (now->type == gate::NOT && i) break;
-				bool flag = false;
-				for (gate* g : now->input[i]->output) {
-					if (g == now) {
-						flag = true;
-						break;
-					}
-				}
-				if (!flag) throw "A gate is not marked as output by its input gate.";
-			}
-		}
-	}
+	validation_report R(validate(*this));
+	// an unused input, only a warning for validate, fails the check as well.
+	if (!R.issues.empty()) throw R.issues.front().message;
 }
 
 
@@ -130,7 +118,7 @@ void circuit::clear_state() {
 	std::queue<gate*> que;
 	std::unordered_set<gate*> set;
 	set.insert(nullptr);
-	for (gate* g : in) {
+	for (gate* g : roots()) {
 		que.push(g);
 		set.insert(g);
 	}
@@ -154,32 +142,25 @@ std::vector<bool> circuit::eval(const std::vector<bool>& input) {
 	std::queue<gate*> que;
 	for (int i(0); i != in.size(); ++i) {
 		gate* g = in[i];
-		g->ready_inputs = 2;
 		g->val = input[i];
 		que.push(g);
 	}
+	for (gate* g : constants) {
+		if (g == nullptr) continue;
+		g->val = (g->type == gate::ONE);
+		que.push(g);
+	}
 	while (!que.empty()) {
 		gate* now(que.front());
 		que.pop();
 		now->ready_inputs = 0;
 		for (gate* g : now->output) {
-			if (++g->ready_inputs == 2) {
-				switch (g->type) {
-				case gate::AND:
-					g->val = (g->input[0]->val && g->input[1]->val);
-					break;
-				case gate::OR:
-					g->val = (g->input[0]->val || g->input[1]->val);
-					break;
-				case gate::XOR:
-					g->val = (g->input[0]->val ^ g->input[1]->val);
-					break;
-				default:
-					return {}; // ill-formed circuit.
-				}
-				que.push(g);
-			} else if (g->ready_inputs == 1 && g->type == gate::NOT) {
-				g->val = !g->input[0]->val;
+			int arity(gate::arity(g->type));
+			if (arity == 0 || g->type >= gate::END_OF_TYPE) return {}; // ill-formed circuit.
+			if (++g->ready_inputs == arity) {
+				bool v[3] = { false, false, false };
+				for (int i(0); i != arity; ++i) v[i] = g->input[i]->val;
+				g->val = gate::apply(g->type, v[0], v[1], v[2]);
 				que.push(g);
 			}
 		}
@@ -195,14 +176,14 @@ int circuit::size() const {
 	int sz = 0;
 	std::queue<gate*> que;
 	std::unordered_set<gate*> set;
-	for (gate* g : in) {
+	for (gate* g : roots()) {
 		que.push(g);
 		set.insert(g);
 	}
 	while (!que.empty()) {
 		gate* now(que.front());
 		que.pop();
-		if (now->type != gate::INPUT && now->type != gate::NOT) {
+		if (now->type != gate::INPUT && now->type != gate::NOT && now->type != gate::ZERO && now->type != gate::ONE) {
 			++sz;
 		}
 		for (gate* g : now->output) {
@@ -220,7 +201,7 @@ void circuit::print() const {
 	std::map<const gate*, int> hash;
 	std::queue<const gate*> que;
 	std::unordered_set<const gate*> set;
-	for (auto g : in) {
+	for (auto g : roots()) {
 		hash[g] = next_num++;
 		que.push(g);
 		set.insert(g);
@@ -254,77 +235,94 @@ void circuit::print() const {
 	}
 }
 
-void circuit::remove_void() {
-	int next_num(1);
-	std::map<const gate*, int> hash;
-	std::queue<const gate*> que;
-	std::queue<const gate*> voidque;
-	std::unordered_set<const gate*> set;
-	for (auto g : in) {
-		hash[g] = next_num++;
-		que.push(g);
-		set.insert(g);
+int circuit::remove_void() {
+	// Number the gates reachable from the roots.
+	std::vector<gate*> order(roots());
+	for (int i(0); i != order.size(); ++i) order[i]->id = i;
+	for (int head(0); head != order.size(); ++head) {
+		for (gate* g : order[head]->output) {
+			if (g->id < 0) {
+				g->id = order.size();
+				order.push_back(g);
+			}
+		}
 	}
-	for (auto g : out) hash[g] = next_num++;
-	while (!que.empty()) {
-		const gate* now(que.front());
-		que.pop();
+	// Mark from the outputs (and the INPUT gates) backwards.
+	std::vector<bool> live(order.size(), false);
+	std::vector<gate*> stack;
+	auto mark = [&](gate* g) {
+		if (g != nullptr && g->id >= 0 && !live[g->id]) {
+			live[g->id] = true;
+			stack.push_back(g);
+		}
+	};
+	for (gate* g : in) mark(g);
+	for (gate* g : out) mark(g);
+	while (!stack.empty()) {
+		gate* now(stack.back());
+		stack.pop_back();
+		for (gate* i : now->input) mark(i);
+	}
+	// Disconnect the dead gates: a live gate only loses consumers, a dead gate loses everything.
+	int removed(0);
+	for (gate* g : order) {
+		if (live[g->id]) {
+			auto& o(g->output);
+			o.erase(std::remove_if(o.begin(), o.end(), [&live](gate* c) { return c->id < 0 || !live[c->id]; }), o.end());
+		} else {
+			++removed;
+		}
+	}
+	for (gate* g : order) {
+		if (!live[g->id]) {
+			g->input[0] = g->input[1] = g->input[2] = nullptr;
+			g->output.clear();
+		}
+	}
+	for (int v(0); v != 2; ++v) {
+		if (constants[v] != nullptr && !live[constants[v]->id]) constants[v] = nullptr;
+	}
+	for (gate* g : order) g->id = -1;
+	return removed;
+}
 
-		for (auto g : now->output) {
-			if (set.find(g) == set.end()) {
-				if (hash.find(g) == hash.end()) hash[g] = next_num++;
-				que.push(g);
-				set.insert(g);
-			}
+std::vector<gate*> circuit::topo_order() const {
+	std::unordered_map<const gate*, int> ready;
+	std::vector<gate*> order(roots());
+	for (int head(0); head != order.size(); ++head) {
+		for (gate* g : order[head]->output) {
+			if (++ready[g] == gate::arity(g->type)) order.push_back(g);
 		}
+	}
+	return order;
+}
 
-		if (now->output.empty()) {
-			bool found(false);
-			for (auto g : out) {
-				if (g == now) {
-					found = true;
-					break;
-				}
+void circuit::replace(gate* g, gate* r) {
+	if (g == r) return;
+	for (gate* c : g->output) {
+		// c appears once in g->output per wire it reads from g.
+		for (int i(0); i != 3; ++i) {
+			if (c->input[i] == g) {
+				c->input[i] = r;
+				r->output.push_back(c);
+				break;
 			}
-			int rank(hash[now]);
-			if (!found) voidque.push(now);
 		}
 	}
-	while (!voidque.empty()) {
-		const gate* now(voidque.front());
-		voidque.pop();
-		int rank = hash[now];
-		std::vector<gate*> ingate;
-		if (now->type == gate::INPUT) throw "INPUT gate not used.";
-		if (now->input[0] == nullptr) throw "Left input wire not connected.";
-		else ingate.push_back(now->input[0]);
-		if (now->input[1] == nullptr) {
-			if (now->type != gate::NOT) throw "Right input wire not connected.";
-		} else ingate.push_back(now->input[1]);
-
-		for (gate* g : ingate) {
-			bool found(false);
-			for (auto itr(g->output.begin()); itr != g->output.end(); ++itr) {
-				if (*itr == now) {
-					found = true;
-					g->output.erase(itr);
-					break;
-				}
-			}
-			if (!found) throw "Not in the output gate list.";
-			if (g->output.empty()) {
-				bool isoutput(false);
-				for (auto gout : out) {
-					if (g == gout) {
-						isoutput = true;
-						break;
-					}
-				}
-				if (!isoutput) voidque.push(g);
+	g->output.clear();
+	for (gate*& o : out) {
+		if (o == g) o = r;
+	}
+	for (int i(0); i != 3; ++i) {
+		gate* src(g->input[i]);
+		if (src == nullptr) continue;
+		for (auto itr(src->output.begin()); itr != src->output.end(); ++itr) {
+			if (*itr == g) {
+				src->output.erase(itr);
+				break;
 			}
 		}
-
-		delete now;
+		g->input[i] = nullptr;
 	}
 }
 
@@ -333,7 +331,7 @@ void circuit::save(std::ostream& stream) {
 	std::map<const gate*, int> hash;
 	std::queue<const gate*> que;
 	std::unordered_set<const gate*> set;
-	for (auto g : in) {
+	for (auto g : roots()) {
 		hash[g] = next_num++;
 		que.push(g);
 		set.insert(g);
@@ -360,7 +358,7 @@ void circuit::save(std::ostream& stream) {
 		}
 		if (found) stream << "OUTPUT";
 		else if (now->output.empty()) stream << "VOID";
-		std::cout << std::endl;
+		stream << std::endl;
 	}
 }
 
@@ -372,66 +370,164 @@ void circuit::copy_from(const circuit& C) {
 circuit::circuit(int fanin, int fanout)
 	: in(fanin, nullptr), out(fanout, nullptr)
 {
-	for (int i(0); i != fanin; ++i) in[i] = new gate(gate::INPUT);
+	for (int i(0); i != fanin; ++i) in[i] = arena.create(gate::INPUT);
 	for (int i(0); i != fanout; ++i) out[i] = nullptr;
 }
 
+gate_arena::gate_arena(gate_arena&& A) noexcept
+	: chunks(std::move(A.chunks)), total(A.total) {
+	A.chunks.clear();
+	A.total = 0;
+}
+
+gate_arena& gate_arena::operator=(gate_arena&& A) noexcept {
+	if (this != &A) {
+		clear();
+		chunks = std::move(A.chunks);
+		total = A.total;
+		A.chunks.clear();
+		A.total = 0;
+	}
+	return *this;
+}
+
+gate_arena::~gate_arena() {
+	clear();
+}
+
+gate* gate_arena::create(gate::gate_type t) {
+	if (chunks.empty() || chunks.back().used == chunks.back().capacity) {
+		int capacity = int(std::min<size_t>(4096, std::max<size_t>(16, total)));
+		chunks.push_back({ static_cast<gate*>(::operator new(sizeof(gate) * capacity)), 0, capacity });
+	}
+	chunk& c(chunks.back());
+	gate* g = new (c.mem + c.used) gate(t);
+	++c.used;
+	++total;
+	return g;
+}
+
+void gate_arena::splice(gate_arena& A) {
+	if (this == &A) return;
+	// Our last chunk may have room left, so keep it last.
+	if (chunks.empty()) chunks = std::move(A.chunks);
+	else chunks.insert(chunks.end() - 1, A.chunks.begin(), A.chunks.end());
+	total += A.total;
+	A.chunks.clear();
+	A.total = 0;
+}
+
+void gate_arena::clear() {
+	for (chunk& c : chunks) {
+		for (int i(0); i != c.used; ++i) c.mem[i].~gate();
+		::operator delete(c.mem);
+	}
+	chunks.clear();
+	total = 0;
+}
+
+size_t gate_arena::count() const {
+	return total;
+}
+
 gate::gate()
-	: input{}, output{}, type(END_OF_TYPE), ready_inputs(0), val(0)
+	: input{}, output{}, type(END_OF_TYPE), ready_inputs(0), val(0), id(-1)
 {
 }
 
 gate::gate(gate_type t)
-	: input{}, output{}, type(t), ready_inputs(0), val(0) {
+	: input{}, output{}, type(t), ready_inputs(0), val(0), id(-1) {
 }
 
-void gate::check() const {
-	if (type < 0 && type >= END_OF_TYPE) throw "Unknown gate.";
-	switch (type)
-	{
+int gate::arity(gate_type t) {
+	switch (t) {
 	case INPUT:
-		if (input[0] != nullptr || input[1] != nullptr) throw "Input gate missing.";
-			if (output.empty()) throw "Input gate not used.";
-		break;
+	case ZERO:
+	case ONE:
+		return 0;
 	case NOT:
-		if (input[0] == nullptr || input[1] != nullptr) throw "NOT gate should have only one input.";
-		break;
+		return 1;
+	case MUX:
+	case MAJ:
+		return 3;
 	default:
-		if (input[0] == nullptr || input[1] == nullptr) throw "Input gate missing.";
-		break;
+		return 2;
+	}
+}
+
+bool gate::apply(gate_type t, bool a, bool b, bool c) {
+	switch (t) {
+	case NOT:
+		return !a;
+	case AND:
+		return a && b;
+	case OR:
+		return a || b;
+	case XOR:
+		return a != b;
+	case NAND:
+		return !(a && b);
+	case NOR:
+		return !(a || b);
+	case XNOR:
+		return a == b;
+	case ANDN:
+		return a && !b;
+	case MUX:
+		return a ? c : b;
+	case MAJ:
+		return (a && b) || (c && (a || b));
+	case ZERO:
+		return false;
+	case ONE:
+		return true;
+	default:
+		throw "Unknown gate.";
+	}
+}
+
+void gate::check() const {
+	if (type < 0 || type >= END_OF_TYPE) throw "Unknown gate.";
+	int arity(gate::arity(type));
+	for (int i(0); i != 3; ++i) {
+		if ((input[i] != nullptr) == (i < arity)) continue;
+		switch (type) {
+		case INPUT:
+			throw "Input gate missing.";
+		case ZERO:
+		case ONE:
+			throw "Constant gate should have no input.";
+		case NOT:
+			throw "NOT gate should have only one input.";
+		default:
+			throw "Input gate missing.";
+		}
 	}
+	if (type == INPUT && output.empty()) throw "Input gate not used.";
 }
 
 void gate::concat(gate* g) {
 	if (g == nullptr) throw "Trying to connect to NULL.";
-	gate* tem = nullptr;
 	if (type == gate::INPUT) {
 		if (output.empty()) throw "INPUT gate has no output.";
 		for (gate* out : output) {
 			out->disconnect(this);
 			out->concat(g);
 		}
-		if (tem) delete tem;
-		delete this;
+		output.clear();
 		return;
 	}
-	if (g == nullptr) throw "Trying to connect to NULL.";
-	if (input[0] == nullptr) {
-		input[0] = g;
-		g->output.push_back(this);
-		if (tem) delete tem;
-		return;
-	} else {
-		if (input[0] == g) throw "Trying to concat two same gates as input.";
-		if (type == NOT) throw "NOT gate can only have one input.";
-		if (input[1] == nullptr) {
-			input[1] = g;
+	int arity(gate::arity(type));
+	for (int i(0); i != arity; ++i) {
+		if (input[i] == g) throw "Trying to concat two same gates as input.";
+		if (input[i] == nullptr) {
+			input[i] = g;
 			g->output.push_back(this);
-			if (tem) delete tem;
 			return;
 		}
-		throw "No room for more inputs.";
 	}
+	if (type == NOT) throw "NOT gate can only have one input.";
+	throw "No room for more inputs.";
 }
 
 void gate::concat(gate* g1, gate* g2) {
@@ -441,69 +537,41 @@ void gate::concat(gate* g1, gate* g2) {
 	concat(g2);
 }
 
+void gate::concat(gate* g1, gate* g2, gate* g3) {
+	if (input[0] != nullptr || input[1] != nullptr || input[2] != nullptr) throw "Input gates already connected.";
+	if (arity(type) != 3) throw "Invalid gate concatenation.";
+	concat(g1);
+	concat(g2);
+	concat(g3);
+}
+
 void gate::disconnect(gate* g) {
 	if (input[0] == g) input[0] = nullptr;
 	else if (input[1] == g) input[1] = nullptr;
+	else if (input[2] == g) input[2] = nullptr;
 	else throw "Nothing to be disconnected.";
 }
 
-void gate::init(gate* arr[], int sz, gate_type type) {
-	for (int i(0); i != sz; ++i) {
-		arr[i] = new gate(type);
-	}
-}
-
 void gate::name(const std::string& newname) {
 	nm = newname;
 }
 
 std::string gate::name() const {
-	switch (type) {
-	case gate::NOT:
-		return "NOT" + nm;
-	case gate::AND:
-		return "AND" + nm;
-	case gate::OR:
-		return "OR" + nm;
-	case gate::XOR:
-		return "XOR" + nm;
-	case gate::INPUT:
-		return "INPUT" + nm;
-	case gate::END_OF_TYPE:
-		return "END_OF_TYPE" + nm;
-	default:
-		throw "Invaild gate type.";
-	}
-	throw "WTF have you done???";
-	return "";
+	return type_name() + nm;
 }
 
 std::string gate::type_name() const {
-	switch (type) {
-	case gate::NOT:
-		return "NOT";
-	case gate::AND:
-		return "AND";
-	case gate::OR:
-		return "OR";
-	case gate::XOR:
-		return "XOR";
-	case gate::INPUT:
-		return "INPUT";
-	case gate::END_OF_TYPE:
-		return "END_OF_TYPE";
-	default:
-		throw "Invaild gate type.";
-	}
-	throw "WTF have you done???";
-	return "";
+	static const char* names[] = { "NOT", "AND", "OR", "XOR", "INPUT", "ZERO", "ONE", "NAND", "NOR", "XNOR", "ANDN", "MUX",
+		"MAJ", "END_OF_TYPE" };
+	if (type < 0 || type > END_OF_TYPE) throw "Invaild gate type.";
+	return names[type];
 }
 
 
 void demo_circuit() {
 	circuit C;
-	gate* gand(new gate(gate::XOR));
-	gate* gin[2] = { new gate(gate::INPUT), new gate(gate::INPUT) };
+	gate* gand(C.new_gate(gate::XOR));
+	gate* gin[2] = { C.new_gate(gate::INPUT), C.new_gate(gate::INPUT) };
 	C.out.push_back(gand);
 	C.in.push_back(gin[0]);
 	C.in.push_back(gin[1]);
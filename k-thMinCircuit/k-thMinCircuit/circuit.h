@@ -5,17 +5,135 @@
 #include <unordered_set>
 #include <queue>
 #include <string>
-class gate;
+#include <cstddef>
+
+/*
+* NOTE: Gates are owned by the arena of a circuit, so create them by circuit::new_gate(...) rather than "new gate(...)".
+*/
+class gate {
+public:
+	enum gate_type {
+		NOT, AND, OR, XOR, INPUT, ZERO, ONE, NAND, NOR, XNOR, ANDN, MUX, MAJ, END_OF_TYPE
+		// for OUTPUT gates, the only non-nullptr wire should be input[0]
+		// ZERO and ONE are constant gates; they have no input wire.
+		// NAND, NOR, XNOR are the negated AND, OR, XOR; ANDN(a, b) = a AND NOT b.
+		// MUX and MAJ have three input wires: MUX(s, a, b) = (s ? b : a), MAJ(a, b, c) = the majority of a, b, c.
+	};
+	gate();
+	gate(gate_type t);
+
+	/*
+	* The number of input wires of a gate of type t: 0 for INPUT and constants, 1 for NOT, 3 for MUX and MAJ, 2 otherwise.
+	*/
+	static int arity(gate_type t);
+
+	/*
+	* The value of a gate of type t on the values of its input wires (those beyond its arity are ignored).
+	*/
+	static bool apply(gate_type t, bool a, bool b, bool c);
+
+	/*
+	* To check if the gate is connected "reasonably":
+	*     if the gate (except input gate) has exactly arity(type) input wires connected
+	*/
+	void check() const;
+	
+	/*
+	* Try to connect the gate in parameter as an input gate; try input[0] first, then [1], [2] up to the arity, FAIL after.
+	* If **this** gate is INPUT gate, it will try concat g to all its output gates.
+	* So please remind that if **this** gate is INPUT, it will be left disconnected (and freed along with its arena).
+	*/
+	void concat(gate *g);
+
+	void concat(gate* g1, gate* g2);
+
+	void concat(gate* g1, gate* g2, gate* g3);
+
+	/*
+	* Return the type of the gate, e.g. "NOT"
+	*/
+	void name(const std::string& newname);
+	std::string name() const;
+	std::string type_name() const;
+
+
+	gate* input[3];
+	std::vector<gate*> output;
+	int ready_inputs;
+	bool val;
+	gate_type type;
+	std::string nm;
+
+	/*
+	* A dense index of the gate, for passes that keep per-gate data in plain arrays (see circuit::remove_void).
+	* Such a pass numbers the gates itself, and sets them back to -1 when it is done.
+	*/
+	int id;
+protected:
+
+	/*
+	* Disconnect g from its input gate.
+	*/
+	void disconnect(gate* g);
+};
+
+/*
+* A gate_arena owns gates: it allocates them in chunks of contiguous memory, and destroys them all at once,
+* without the need to discover them by traveling the circuit.
+* Chunks grow geometrically (up to 4096 gates), so small circuits stay small.
+*/
+class gate_arena {
+public:
+	gate_arena() = default;
+	gate_arena(gate_arena&& A) noexcept;
+	gate_arena& operator=(gate_arena&& A) noexcept;
+	gate_arena(const gate_arena&) = delete;
+	gate_arena& operator=(const gate_arena&) = delete;
+	~gate_arena();
+
+	/*
+	* Construct a new gate of type t in the arena.
+	*/
+	gate* create(gate::gate_type t);
+
+	/*
+	* Take over all gates of A; A becomes empty.
+	*/
+	void splice(gate_arena& A);
+
+	/*
+	* Destroy every gate in the arena, and free the memory.
+	*/
+	void clear();
+
+	/*
+	* Number of gates ever created in (or spliced into) the arena, including those no longer connected.
+	*/
+	size_t count() const;
+
+private:
+	struct chunk {
+		gate* mem;
+		int used, capacity;
+	};
+	std::vector<chunk> chunks;
+	size_t total = 0;
+};
+
 class circuit {
 public:
 	circuit() = default;
 
+	circuit(circuit&& C) noexcept;
+	circuit& operator=(circuit&& C) noexcept;
+
 	/*
-	* To construct a circuit that shares a same topology of C
+	* To construct a circuit that shares a same topology of C, with gates of its own (C must be well-formed).
 	* It guarantees that the order of input wire is preserved,
 	* i.e. the input[0] of a gate in C is input[0] of the corresponding gate in *this.
 	* 
-	* So is the output vector.
+	* So is the output vector, and so are in and out.
+	* Gates of C not reachable from its inputs or constants are not copied.
 	*/
 	circuit(const circuit& C);
 
@@ -24,29 +142,59 @@ public:
 
 	/*
 	* To deconstruct the entire circuit.
-	* All gates will be deconstructed.
+	* All gates will be deconstructed, by freeing the arena.
 	*/
 	void clear();
 
 	/*
 	* This function erase the in\out vector, but not destroy any gate.
-	* This prevents the deconstruction of circuit from destroying every gate in it.
+	* Note that the gates are still owned by the arena of this circuit;
+	* to use this circuit as a module of a bigger one, call adopt instead.
 	*/
 	void moderate_clear();
 
+	/*
+	* Take over every gate of C (so that they live as long as *this), then moderate_clear C.
+	* This is how a circuit is used as a module of a bigger circuit:
+	* connect the wires of C properly to the outer part, and then adopt it.
+	*/
+	void adopt(circuit& C);
+
+	/*
+	* Create a gate in the arena of this circuit.
+	* Every gate of a circuit must be created this way (or by a module that is later adopted).
+	*/
+	gate* new_gate(gate::gate_type type);
+
+	/*
+	* Create sz many gates of the same type.
+	*/
+	void new_gates(gate* arr[], int sz, gate::gate_type type);
+
+	/*
+	* Return the constant gate (ZERO or ONE) of this circuit, creating it on first use.
+	* There is at most one constant gate of each value per circuit; adopt merges those of the module.
+	*/
+	gate* constant(bool v);
+
+	/*
+	* The gates evaluation starts from: the INPUT gates, in order, followed by the constant gates, if any.
+	*/
+	std::vector<gate*> roots() const;
+
 	/*
 	* To check if the circuit is well-formed.
 	* 
 	*     1. if every input gate is of type INPUT
 	*     2. if every common gate is not of type INPUT
 	*     3. if each gate is recorded as output by its input gates
-	*     4. if each gate (except INPUT) has two input wires connected
-	*     5. if each gate (except outputing one) has its output vector non-empty
+	*     4. if each gate has as many input wires connected as its arity
+	*     5. if every output gate is reachable from roots()
+	*     6. if every INPUT gate is used
+	*     7. if there is no loop in the circuit
 	* 
-	* The last two is done by gate::check()
-	* If check fail, it throws exception.
+	* It is done by validate (see validator.h) in linear time; if check fails, it throws the message of the first issue.
 	* Note that, in a well-formed circuit, enumeration of gates can be done by starting from in and traveling by output vector.
-	* I.e. the user is response for making sure that there is no loop in the circuit.
 	*/
 	void check() const;
 
@@ -64,7 +212,7 @@ public:
 
 	/*
 	* Count the size of the circuit.
-	* Note that this will not count in NOT gate and INPUT gate.
+	* Note that this will not count in NOT gate, INPUT gate and constant gates; every other gate counts 1, MUX and MAJ included.
 	*/
 	int size() const;
 
@@ -76,11 +224,30 @@ public:
 	void print() const;
 
 	/*
-	* Remove every gate that is not output gate, and does not have its output wire connected.
+	* Dead-logic elimination: remove every gate no output depends on, i.e. the gates left without output,
+	* and the gates whose consumers are all removed, and so on.
+	* The removed gates are disconnected; their memory is freed along with the arena.
+	* INPUT gates are never removed, even if unused; an unused constant gate is.
+	* 
+	* It marks the live gates from the outputs over a dense numbering of the gates, in O(V + E).
+	* It returns the number of gates removed.
 	*/
-	void remove_void();
+	int remove_void();
 
 
+	/*
+	* Return the gates reachable from roots(), in a topological order (roots first, in order).
+	* The circuit must be well-formed.
+	*/
+	std::vector<gate*> topo_order() const;
+
+	/*
+	* Let r take the place of g: every gate reading g reads r instead, and every output slot holding g holds r.
+	* g is then disconnected from its input gates, and left without output (it stays in the arena).
+	* r must not depend on g.
+	*/
+	void replace(gate* g, gate* r);
+
 	/*
 	* Output the entire circuit. If you would like to save it?
 	*/
@@ -91,6 +258,9 @@ public:
 
 	std::vector<gate*> in, out;
 protected:
+	gate_arena arena;
+	gate* constants[2] = { nullptr, nullptr };
+
 	/*
 	* This construction function init the circuit in and out to appointed number
 	*/
@@ -99,61 +269,4 @@ protected:
 
 
 
-/*
-* NOTE: Due to the design of ~circuit, you should only use "new gate(...)" to create gate object.
-* In particular, do not use new gate[](...).
-* You can use gate::init to initialize a gate pointer array.
-*/
-class gate {
-public:
-	enum gate_type {
-		NOT, AND, OR, XOR, INPUT, END_OF_TYPE
-		// for OUTPUT gates, the only non-nullptr wire should be input[0]
-	};
-	gate();
-	gate(gate_type t);
-
-	/*
-	* To check if the gate is connected "reasonably":
-	*     if the gate (except input gate) has two input wires connected
-	*/
-	void check() const;
-	
-	/*
-	* Try to connect the gate in parameter as an input gate; try input[0] first, [1] second, FAIL third.
-	* If **this** gate is INPUT gate, it will try concat g to all its output gates.
-	* So please remind that if **this** gate is INPUT, it will be destroyed.
-	*/
-	void concat(gate *g);
-
-	void concat(gate* g1, gate* g2);
-
-
-	/*
-	* This function calls operator new to allocate sz many gates.
-	*/
-	static void init(gate* arr[], int sz, gate_type type);
-
-	/*
-	* Return the type of the gate, e.g. "NOT"
-	*/
-	void name(const std::string& newname);
-	std::string name() const;
-	std::string type_name() const;
-
-
-	gate* input[2];
-	std::vector<gate*> output;
-	int ready_inputs;
-	bool val;
-	gate_type type;
-	std::string nm;
-protected:
-
-	/*
-	* Disconnect g from its input gate.
-	*/
-	void disconnect(gate* g);
-};
-
 void demo_circuit();
@@ -0,0 +1,446 @@
+#include "circuit_opt.h"
+#include "compiled_circuit.h"
+#include "kmin_circuit.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+
+/*
+* The key of a gate in the hash table: (type, input[0], input[1], input[2]), inputs sorted for commutative gates.
+*/
+struct _strash_key {
+	int type;
+	const gate* a, * b, * c;
+	bool operator==(const _strash_key& k) const {
+		return type == k.type && a == k.a && b == k.b && c == k.c;
+	}
+};
+
+struct _strash_hash {
+	size_t operator()(const _strash_key& k) const {
+		size_t h = std::hash<const gate*>()(k.a);
+		h ^= std::hash<const gate*>()(k.b) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		h ^= std::hash<const gate*>()(k.c) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		return h ^ size_t(k.type);
+	}
+};
+
+/*
+* Whether the value of a gate of type t does not depend on the order of its inputs; ANDN and MUX do.
+*/
+static bool _commutative(int t) {
+	return t != gate::NOT && t != gate::ANDN && t != gate::MUX;
+}
+
+static bool _is_const(const gate* g) {
+	return g->type == gate::ZERO || g->type == gate::ONE;
+}
+
+/*
+* Return a gate equivalent to g among g's inputs (or their inputs) or the constants, or nullptr if no rule applies.
+*/
+static gate* _simplify(circuit& C, gate* g) {
+	gate* a(g->input[0]), * b(g->input[1]);
+	switch (g->type) {
+	case gate::NOT:
+		if (a->type == gate::NOT) return a->input[0];
+		break;
+	case gate::XOR:
+		if (a == b) return C.constant(false);
+		if ((a->type == gate::NOT && a->input[0] == b) || (b->type == gate::NOT && b->input[0] == a)) return C.constant(true);
+		break;
+	case gate::AND:
+	case gate::OR: {
+		if (a == b) return a;
+		// x AND NOT(x) = 0, x OR NOT(x) = 1
+		if ((a->type == gate::NOT && a->input[0] == b) || (b->type == gate::NOT && b->input[0] == a)) {
+			return C.constant(g->type == gate::OR);
+		}
+		// absorption: x op (x op' y) = x
+		gate::gate_type dual = (g->type == gate::AND ? gate::OR : gate::AND);
+		for (int i(0); i != 2; ++i) {
+			gate* x(i ? b : a), * y(i ? a : b);
+			if (y->type == dual && (y->input[0] == x || y->input[1] == x)) return x;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	return nullptr;
+}
+
+int strash(circuit& C) {
+	int before = C.topo_order().size();
+	std::unordered_map<_strash_key, gate*, _strash_hash> table;
+	for (gate* g : C.topo_order()) {
+		if (g->type == gate::INPUT || _is_const(g)) continue;
+		if (gate* r = _simplify(C, g)) {
+			C.replace(g, r);
+			continue;
+		}
+		if (g->type == gate::XOR && g->input[0]->type == gate::NOT && g->input[1]->type == gate::NOT) {
+			// rewire g to read x and y directly; the two NOT gates may become void.
+			gate* x(g->input[0]->input[0]), * y(g->input[1]->input[0]);
+			for (int i(0); i != 2; ++i) {
+				auto& o(g->input[i]->output);
+				for (auto itr(o.begin()); itr != o.end(); ++itr) {
+					if (*itr == g) {
+						o.erase(itr);
+						break;
+					}
+				}
+			}
+			g->input[0] = x, g->input[1] = y;
+			x->output.push_back(g);
+			y->output.push_back(g);
+			// the NOT gates are kept alive until remove_void, if they are unused now.
+		}
+		_strash_key key{ g->type, g->input[0], g->input[1], g->input[2] };
+		if (_commutative(g->type)) {
+			std::less<const gate*> less;
+			if (less(key.b, key.a)) std::swap(key.a, key.b);
+			if (key.c != nullptr && less(key.c, key.b)) std::swap(key.b, key.c);
+			if (less(key.b, key.a)) std::swap(key.a, key.b);
+		}
+		auto itr = table.find(key);
+		if (itr == table.end()) table[key] = g;
+		else C.replace(g, itr->second);
+	}
+	C.remove_void();
+	return before - int(C.topo_order().size());
+}
+
+/*
+* A gate of value NOT(a): a's input if a is a NOT gate, otherwise a new NOT gate.
+*/
+static gate* _negate(circuit& C, gate* a) {
+	if (a->type == gate::NOT) return a->input[0];
+	gate* gnot(C.new_gate(gate::NOT));
+	gnot->concat(a);
+	return gnot;
+}
+
+/*
+* AND(x, y), OR(x, y) or ANDN(x, y); replace may have left x and y the same gate, then AND(x, x) = OR(x, x) = x
+* and ANDN(x, x) = 0.
+*/
+static gate* _binary(circuit& C, gate::gate_type t, gate* x, gate* y) {
+	if (x == y) return t == gate::ANDN ? C.constant(false) : x;
+	gate* r(C.new_gate(t));
+	r->concat(x, y);
+	return r;
+}
+
+/*
+* Fold the constants into a NAND, NOR, XNOR, ANDN, MUX or MAJ gate g; return what g is to be replaced with,
+* or nullptr if none of its inputs is constant.
+*/
+static gate* _fold_extended(circuit& C, gate* g) {
+	gate* a(g->input[0]), * b(g->input[1]), * c(g->input[2]);
+	int arity(gate::arity(g->type));
+	bool all(true), any(false);
+	for (int i(0); i != arity; ++i) {
+		all = all && _is_const(g->input[i]);
+		any = any || _is_const(g->input[i]);
+	}
+	if (!any) return nullptr;
+	auto v = [](const gate* x) { return x->type == gate::ONE; };
+	if (all) return C.constant(gate::apply(g->type, v(a), arity > 1 && v(b), arity > 2 && v(c)));
+	switch (g->type) {
+	case gate::NAND:
+	case gate::NOR:
+	case gate::XNOR:
+		if (!_is_const(b)) std::swap(a, b);
+		// NAND(x, 1) = NOR(x, 0) = XNOR(x, 0) = NOT(x); NAND(x, 0) = 1, NOR(x, 1) = 0, XNOR(x, 1) = x
+		if (g->type == gate::NAND) return v(b) ? _negate(C, a) : C.constant(true);
+		if (g->type == gate::NOR) return v(b) ? C.constant(false) : _negate(C, a);
+		return v(b) ? a : _negate(C, a);
+	case gate::ANDN:
+		// ANDN(x, 1) = ANDN(0, x) = 0, ANDN(x, 0) = x, ANDN(1, x) = NOT(x)
+		if (_is_const(b)) return v(b) ? C.constant(false) : a;
+		return v(a) ? _negate(C, b) : C.constant(false);
+	case gate::MUX: {
+		if (_is_const(a)) return v(a) ? c : b;
+		// MUX(s, 0, 1) = s, MUX(s, 1, 0) = NOT(s), MUX(s, x, x) = x
+		if (_is_const(b) && _is_const(c)) return v(b) == v(c) ? b : (v(c) ? a : _negate(C, a));
+		if (_is_const(b)) {
+			// MUX(s, 0, s) = s, MUX(s, 1, s) = 1
+			if (c == a) return v(b) ? C.constant(true) : a;
+			// MUX(s, 0, x) = AND(s, x), MUX(s, 1, x) = OR(NOT(s), x)
+			return v(b) ? _binary(C, gate::OR, _negate(C, a), c) : _binary(C, gate::AND, a, c);
+		}
+		// MUX(s, s, 0) = 0, MUX(s, s, 1) = s
+		if (b == a) return v(c) ? a : C.constant(false);
+		// MUX(s, x, 0) = ANDN(x, s), MUX(s, x, 1) = OR(s, x)
+		return v(c) ? _binary(C, gate::OR, a, b) : _binary(C, gate::ANDN, b, a);
+	}
+	case gate::MAJ: {
+		// MAJ(x, y, 0) = AND(x, y), MAJ(x, y, 1) = OR(x, y); with two constants, see above.
+		gate* in[3] = { a, b, c };
+		std::stable_partition(in, in + 3, [](const gate* x) { return !_is_const(x); });
+		if (_is_const(in[1])) return v(in[1]) == v(in[2]) ? in[1] : in[0];
+		// MAJ(x, x, c) = x
+		return _binary(C, v(in[2]) ? gate::OR : gate::AND, in[0], in[1]);
+	}
+	default:
+		throw "Unknown gate.";
+	}
+}
+
+int propagate_constants(circuit& C) {
+	int before = C.topo_order().size();
+	for (gate* g : C.topo_order()) {
+		if (g->type == gate::INPUT || _is_const(g)) continue;
+		gate* a(g->input[0]), * b(g->input[1]);
+		if (g->type == gate::NOT) {
+			if (_is_const(a)) C.replace(g, C.constant(a->type == gate::ZERO));
+			continue;
+		}
+		if (g->type != gate::AND && g->type != gate::OR && g->type != gate::XOR) {
+			if (gate* r = _fold_extended(C, g)) C.replace(g, r);
+			continue;
+		}
+		if (!_is_const(b)) std::swap(a, b);
+		if (!_is_const(b)) continue;
+		bool v(b->type == gate::ONE);
+		if (_is_const(a)) {
+			bool u(a->type == gate::ONE);
+			switch (g->type) {
+			case gate::AND:
+				C.replace(g, C.constant(u && v));
+				break;
+			case gate::OR:
+				C.replace(g, C.constant(u || v));
+				break;
+			case gate::XOR:
+				C.replace(g, C.constant(u != v));
+				break;
+			default:
+				throw "Unknown gate.";
+			}
+			continue;
+		}
+		switch (g->type) {
+		case gate::AND:
+			C.replace(g, v ? a : C.constant(false));
+			break;
+		case gate::OR:
+			C.replace(g, v ? C.constant(true) : a);
+			break;
+		case gate::XOR:
+			if (!v) C.replace(g, a);
+			else if (a->type == gate::NOT) C.replace(g, a->input[0]);
+			else {
+				gate* gnot(C.new_gate(gate::NOT));
+				gnot->concat(a);
+				C.replace(g, gnot);
+			}
+			break;
+		default:
+			throw "Unknown gate.";
+		}
+	}
+	C.remove_void();
+	return before - int(C.topo_order().size());
+}
+
+static void _report(const std::string& name, circuit& C) {
+	C.check();
+	int size_before(C.size()), gates_before(compiled_circuit(C).gate_count());
+	std::vector<std::vector<bool>> inputs(64);
+	for (auto& input : inputs) {
+		for (int i(0); i != C.in.size(); ++i) input.push_back(rand() % 2);
+	}
+	std::vector<std::vector<bool>> expected;
+	for (auto& input : inputs) expected.push_back(C.eval(input));
+	int removed = strash(C);
+	C.check();
+	bool wrong(false);
+	for (int i(0); i != inputs.size(); ++i) {
+		if (C.eval(inputs[i]) != expected[i]) wrong = true;
+	}
+	std::cout << name << ": size " << size_before << " -> " << C.size() << ", gates (with NOT/INPUT) " << gates_before
+		<< " -> " << compiled_circuit(C).gate_count() << ", removed " << removed << (wrong ? "  WRONG" : "") << std::endl;
+}
+
+void test_strash() {
+	{
+		adder_circuit C;
+		_report("adder_circuit", C);
+	}
+	{
+		bitadder_circuit C(100);
+		_report("bitadder_circuit(100)", C);
+	}
+	{
+		compare_circuit C(32);
+		_report("compare_circuit(32)", C);
+	}
+	{
+		less_circuit C(32);
+		_report("less_circuit(32)", C);
+	}
+	{
+		int_adder C(32);
+		_report("int_adder(32)", C);
+	}
+	{
+		exint_adder C(32);
+		_report("exint_adder(32)", C);
+	}
+	{
+		selector C(32);
+		_report("selector(32)", C);
+	}
+	{
+		kmin_circuit C(100, 32);
+		_report("kmin_circuit(100, 32)", C);
+	}
+}
+
+/*
+* x + c with a constant c, by tying the second operand of int_adder to constants.
+*/
+class _const_adder :
+	public circuit
+{
+public:
+	_const_adder(int n, int c)
+		: circuit(n, n)
+	{
+		int_adder adder(n);
+		for (int i(0); i != n; ++i) adder.in[i]->concat(in[i]);
+		for (int i(0); i != n; ++i) adder.in[i + n]->concat(constant((c >> (n - i - 1)) & 1));
+		out = adder.out;
+		adopt(adder);
+	}
+};
+
+/*
+* A bare circuit of two inputs and three outputs, for the cases of test_propagate_constants.
+* The last two outputs are the inputs, so that they stay in use whatever the first output folds into.
+*/
+class _two_input :
+	public circuit
+{
+public:
+	_two_input()
+		: circuit(2, 3)
+	{
+		out[1] = in[0];
+		out[2] = in[1];
+	}
+};
+
+void test_propagate_constants() {
+	const int n(16), c(12345);
+	bool wrong(false);
+	_const_adder C(n, c);
+	C.check();
+	int before(C.size());
+	int removed = propagate_constants(C);
+	C.check();
+	std::cout << "int_adder(" << n << ") + constant: size " << before << " -> " << C.size() << ", removed " << removed << std::endl;
+	for (int _(0); _ != 100; ++_) {
+		int x = rand() % (1 << n);
+		std::vector<bool> input;
+		for (int i(n - 1); i >= 0; --i) input.push_back((x >> i) & 1);
+		auto ret = C.eval(input);
+		int res(0);
+		for (int i(0); i != n; ++i) res = res * 2 + ret[i];
+		if (res != ((x + c) & ((1 << n) - 1))) wrong = true;
+	}
+	{
+		// kmin_circuit folds its zero wire while being built.
+		kmin_circuit K(100, 32);
+		K.check();
+		std::cout << "kmin_circuit(100, 32): size " << K.size() << ", " << K.in.size() << " inputs" << std::endl;
+	}
+	{
+		// MUX and MAJ whose inputs become the same wire once the constants are folded.
+		// Operands: s and y are the inputs, S = OR(s, 0) (becomes s), 0 = AND(y, 0), 1 = OR(y, 1), n = NOT(y).
+		const char* cases[][4] = { { "MUX", "s", "0", "S" }, { "MUX", "s", "1", "S" }, { "MUX", "s", "S", "0" },
+			{ "MUX", "s", "S", "1" }, { "MUX", "n", "1", "y" }, { "MUX", "S", "s", "0" }, { "MAJ", "S", "s", "0" },
+			{ "MAJ", "S", "s", "1" }, { "MAJ", "0", "S", "s" } };
+		for (auto& k : cases) {
+			_two_input D;
+			gate* s(D.in[0]), * y(D.in[1]);
+			auto operand = [&](char o) {
+				if (o == 's') return s;
+				if (o == 'y') return y;
+				gate* g(D.new_gate(o == 'S' || o == '1' ? gate::OR : o == '0' ? gate::AND : gate::NOT));
+				if (o == 'S') g->concat(s, D.constant(false));
+				else if (o == '0') g->concat(y, D.constant(false));
+				else if (o == '1') g->concat(y, D.constant(true));
+				else g->concat(y);
+				return g;
+			};
+			gate* g(D.new_gate(std::string(k[0]) == "MUX" ? gate::MUX : gate::MAJ));
+			g->concat(operand(k[1][0]), operand(k[2][0]), operand(k[3][0]));
+			D.out[0] = g;
+			D.check();
+			std::vector<std::vector<bool>> expected;
+			for (int x(0); x != 4; ++x) expected.push_back(D.eval({ bool(x & 1), bool(x & 2) }));
+			try {
+				propagate_constants(D);
+				D.check();
+				for (int x(0); x != 4; ++x) {
+					if (D.eval({ bool(x & 1), bool(x & 2) }) != expected[x]) throw "Wrong value.";
+				}
+			} catch (const char* e) {
+				std::cout << k[0] << "(" << k[1] << ", " << k[2] << ", " << k[3] << "): " << e << std::endl;
+				wrong = true;
+			}
+		}
+	}
+	if (wrong) std::cout << "test_propagate_constants: wrong." << std::endl;
+	else std::cout << "test_propagate_constants: passed." << std::endl;
+}
+
+/*
+* int_adder(n), with a dead chain of m gates hanging off each output (they read it, but nothing reads them).
+*/
+class _dangling_adder :
+	public circuit
+{
+public:
+	_dangling_adder(int n, int m)
+		: circuit(2 * n, n)
+	{
+		int_adder adder(n);
+		for (int i(0); i != 2 * n; ++i) adder.in[i]->concat(in[i]);
+		out = adder.out;
+		adopt(adder);
+		for (int i(0); i != n; ++i) {
+			gate* prev(out[i]);
+			for (int j(0); j != m; ++j) {
+				gate* g(new_gate(j % 2 ? gate::AND : gate::XOR));
+				g->concat(prev, in[(i + j) % (2 * n)]);
+				prev = g;
+			}
+		}
+	}
+};
+
+void test_remove_void() {
+	const int n(4096), m(64);
+	bool wrong(false);
+	_dangling_adder C(n, m);
+	std::vector<bool> input;
+	for (int i(0); i != 2 * n; ++i) input.push_back(rand() % 2);
+	auto expected = C.eval(input);
+	int before(C.topo_order().size());
+	auto t0 = std::chrono::steady_clock::now();
+	int removed = C.remove_void();
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	C.check();
+	std::cout << "int_adder(" << n << ") with " << n * m << " dead gates: " << before << " gates, removed " << removed
+		<< " in " << sec * 1e3 << " ms" << std::endl;
+	if (removed != n * m || before - removed != int(C.topo_order().size()) || C.eval(input) != expected) wrong = true;
+	if (C.remove_void() != 0) wrong = true;
+	if (wrong) std::cout << "test_remove_void: wrong." << std::endl;
+	else std::cout << "test_remove_void: passed." << std::endl;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "circuit.h"
+
+/*
+* Structural hashing: an optimization pass that merges redundant logic of a well-formed circuit, in place.
+*
+* Gates are visited in topological order. Each gate is first simplified locally:
+*     NOT(NOT(x)) = x
+*     AND(x, x) = OR(x, x) = x
+*     XOR(x, x) = 0, XOR(x, NOT(x)) = 1
+*     AND(x, NOT(x)) = 0, OR(x, NOT(x)) = 1
+*     OR(x, AND(x, y)) = AND(x, OR(x, y)) = x        (absorption)
+*     XOR(NOT(x), NOT(y)) = XOR(x, y)
+* (the other gate types are only hashed)
+* then looked up in a table of the gates seen so far, keyed by (type, inputs) with the inputs of commutative gates sorted;
+* a gate with the same key is merged into the one in the table.
+* Gates left without output afterwards are removed by circuit::remove_void.
+*
+* Merged and removed gates are disconnected, and freed along with the arena.
+* It returns the number of gates (including NOT gates) removed from the circuit.
+*/
+int strash(circuit& C);
+
+/*
+* Constant propagation: fold the constant gates (see circuit::constant) through every gate type, in place.
+*     AND(x, 0) = 0, AND(x, 1) = x, OR(x, 1) = 1, OR(x, 0) = x, XOR(x, 0) = x, XOR(x, 1) = NOT(x)
+* and likewise for NAND, NOR, XNOR and ANDN; MUX and MAJ with one constant input become a two-input gate,
+*     MUX(s, 0, x) = AND(s, x), MUX(s, x, 0) = ANDN(x, s), MAJ(x, y, 0) = AND(x, y), MAJ(x, y, 1) = OR(x, y)
+* Gates folded away are removed (see circuit::remove_void); an output may become a constant gate.
+* It returns the number of gates (including NOT gates) removed from the circuit.
+*/
+int propagate_constants(circuit& C);
+
+void test_strash();
+
+void test_propagate_constants();
+
+void test_remove_void();
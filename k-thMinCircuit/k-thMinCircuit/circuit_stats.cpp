@@ -0,0 +1,127 @@
+#include "circuit_stats.h"
+#include "kmin_circuit.h"
+
+#include <sstream>
+
+circuit_stats::circuit_stats(const compiled_circuit& C) {
+	gates = C.gate_count();
+	inputs = C.fanin();
+	outputs = C.fanout();
+	levels = std::max(0, int(C.level_begin.size()) - 1);
+	compiled_bytes = C.type.size() * sizeof(unsigned char) + (C.in0.size() + C.in1.size() + C.in2.size() + C.level_begin.size() + C.out.size()) * sizeof(int);
+
+	// The gates are sorted by level, so the longest path to every gate is known when it is visited.
+	std::vector<int> fanout(gates, 0), dist(gates, 0), pred(gates, -1);
+	for (int d(0); d != levels; ++d) {
+		int width(C.level_begin[d + 1] - C.level_begin[d]);
+		if (width > widest_level_width) {
+			widest_level = d;
+			widest_level_width = width;
+		}
+		for (int g(C.level_begin[d]); g != C.level_begin[d + 1]; ++g) {
+			++count[C.type[g]];
+			int fanin(0);
+			for (int in : { C.in0[g], C.in1[g], C.in2[g] }) {
+				if (in < 0) continue;
+				++fanin;
+				++fanout[in];
+				int w(dist[in] + (C.type[g] == gate::NOT ? 0 : 1));
+				if (pred[g] < 0 || w > dist[g]) {
+					dist[g] = w;
+					pred[g] = in;
+				}
+			}
+			++fanin_histogram[fanin];
+			edges += fanin;
+		}
+	}
+	size = gates - count[gate::INPUT] - count[gate::NOT] - count[gate::ZERO] - count[gate::ONE];
+	for (int f : fanout) {
+		++fanout_histogram[f];
+		max_fanout = std::max(max_fanout, f);
+	}
+	int last(-1);
+	for (int g : C.out) {
+		if (last < 0 || dist[g] > dist[last]) last = g;
+	}
+	if (last >= 0) {
+		depth = dist[last];
+		for (int g(last); g >= 0; g = pred[g]) critical_path.push_back(g);
+		critical_path = std::vector<int>(critical_path.rbegin(), critical_path.rend());
+	}
+}
+
+circuit_stats::circuit_stats(const circuit& C)
+	: circuit_stats(compiled_circuit(C))
+{
+	// every gate of C has one entry in the compiled arrays, and every edge one entry in an output vector
+	graph_bytes = size_t(gates) * sizeof(gate) + size_t(edges) * sizeof(gate*);
+}
+
+void circuit_stats::json(std::ostream& stream) const {
+	stream << "{\"gates\": " << gates << ", \"size\": " << size << ", \"count\": {";
+	for (int t(0); t != gate::END_OF_TYPE; ++t) {
+		stream << (t ? ", " : "") << "\"" << gate(gate::gate_type(t)).type_name() << "\": " << count[t];
+	}
+	stream << "}, \"inputs\": " << inputs << ", \"outputs\": " << outputs << ", \"edges\": " << edges
+		<< ", \"depth\": " << depth << ", \"levels\": " << levels
+		<< ", \"widest_level\": " << widest_level << ", \"widest_level_width\": " << widest_level_width
+		<< ", \"critical_path\": [";
+	for (int i(0); i != critical_path.size(); ++i) stream << (i ? ", " : "") << critical_path[i];
+	stream << "], \"fanin_histogram\": {";
+	bool first(true);
+	for (auto& kv : fanin_histogram) {
+		stream << (first ? "" : ", ") << "\"" << kv.first << "\": " << kv.second;
+		first = false;
+	}
+	stream << "}, \"fanout_histogram\": {";
+	first = true;
+	for (auto& kv : fanout_histogram) {
+		stream << (first ? "" : ", ") << "\"" << kv.first << "\": " << kv.second;
+		first = false;
+	}
+	stream << "}, \"max_fanout\": " << max_fanout << ", \"compiled_bytes\": " << compiled_bytes
+		<< ", \"graph_bytes\": " << graph_bytes << "}";
+}
+
+std::string circuit_stats::json() const {
+	std::ostringstream stream;
+	json(stream);
+	return stream.str();
+}
+
+void test_circuit_stats() {
+	bool wrong(false);
+	{
+		// a full adder: the sum is XOR -> XOR and the carry a single MAJ, so the depth is 2.
+		adder_circuit C;
+		circuit_stats S(C);
+		std::cout << "adder_circuit: " << S.json() << std::endl;
+		if (S.size != C.size() || S.depth != 2 || S.critical_path.size() != 3 || S.count[gate::XOR] != 2 || S.count[gate::MAJ] != 1) wrong = true;
+	}
+	for (int n : { 16, 100 }) {
+		for (int l : { 16, 64 }) {
+			kmin_options opt[2];
+			opt[1].popcount = kmin_options::CSA_POPCOUNT;
+			opt[1].comparator = kmin_options::TREE_COMPARATOR;
+			for (int v(0); v != 2; ++v) {
+				kmin_circuit C(n, l, opt[v]);
+				circuit_stats S(C);
+				compiled_circuit CC(C);
+				// the critical path runs from an INPUT gate along wires, and has depth + (NOT gates on it) + 1 gates
+				const std::vector<int>& P(S.critical_path);
+				int nots(0);
+				for (int i(1); i != P.size(); ++i) {
+					if (CC.in0[P[i]] != P[i - 1] && CC.in1[P[i]] != P[i - 1] && CC.in2[P[i]] != P[i - 1]) wrong = true;
+					if (CC.type[P[i]] == gate::NOT) ++nots;
+				}
+				if (S.size != C.size() || P.empty() || P[0] >= S.inputs || P.size() != S.depth + nots + 1) wrong = true;
+				std::cout << "kmin_circuit(" << n << ", " << l << (v ? ", csa + tree" : "") << "): size " << S.size
+					<< ", depth " << S.depth << ", levels " << S.levels << ", widest level " << S.widest_level_width
+					<< ", max fan-out " << S.max_fanout << ", " << S.compiled_bytes << " / " << S.graph_bytes << " bytes" << std::endl;
+			}
+		}
+	}
+	if (wrong) std::cout << "test_circuit_stats: wrong." << std::endl;
+	else std::cout << "test_circuit_stats: passed." << std::endl;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "circuit.h"
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <iostream>
+
+/*
+* A report of the shape and the cost of a circuit, to compare generator variants.
+*
+* It is computed from the compiled form in one linear sweep over the gates (see compiled_circuit),
+* so gate indices below are those of the compiled circuit: [0, fan-in) are the INPUT gates.
+* Built from a circuit, it also reports the memory of the pointer-based gates.
+*/
+struct circuit_stats {
+	explicit circuit_stats(const compiled_circuit& C);
+	explicit circuit_stats(const circuit& C);
+
+	int gates = 0;                      // all gates, including INPUT, NOT and constant gates
+	int size = 0;                       // the same as circuit::size
+	int count[gate::END_OF_TYPE] = {};  // gates per type
+	int inputs = 0, outputs = 0;
+	long long edges = 0;                // wires between gates
+
+	/*
+	* The depth is the longest path (in gates, NOT included) from an INPUT gate to an output;
+	* levels is the number of levels of the compiled circuit (depth + 1, unless a gate is left unused).
+	* critical_path lists the gates of one longest path, from an INPUT gate to an output gate.
+	*/
+	int depth = 0, levels = 0;
+	int widest_level = 0, widest_level_width = 0;
+	std::vector<int> critical_path;
+
+	/*
+	* fanin_histogram[k] / fanout_histogram[k] is the number of gates with k input / output wires.
+	*/
+	std::map<int, int> fanin_histogram, fanout_histogram;
+	int max_fanout = 0;
+
+	/*
+	* Bytes of the compiled arrays; and, if built from a circuit, of its gates and their output vectors
+	* (0 otherwise). Strings (gate names) are not counted.
+	*/
+	size_t compiled_bytes = 0, graph_bytes = 0;
+
+	/*
+	* Write the report as one JSON object.
+	*/
+	void json(std::ostream& stream) const;
+	std::string json() const;
+};
+
+void test_circuit_stats();
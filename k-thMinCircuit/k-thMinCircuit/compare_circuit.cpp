@@ -1,4 +1,42 @@
 #include "compare_circuit.h"
+#include "compiled_circuit.h"
+#include "kmin_circuit.h"
+
+/*
+* The result of comparing x[begin, end) with y[begin, end); gt is only built on request.
+*/
+struct _cmp_result {
+	gate* eq, * lt, * gt;
+};
+
+/*
+* Compare x[begin, end) and y[begin, end), where x = C.in[0, n) and y = C.in[n, 2n).
+* The eq gates that are never used (those of the lowest halves) are left to remove_void.
+*/
+static _cmp_result _tree_compare(circuit& C, int n, int begin, int end, bool with_gt) {
+	if (end - begin == 1) {
+		gate* x(C.in[begin]), * y(C.in[begin + n]);
+		_cmp_result r{ C.new_gate(gate::XNOR), C.new_gate(gate::ANDN), nullptr };
+		r.eq->concat(x, y);
+		r.lt->concat(y, x);
+		if (with_gt) {
+			r.gt = C.new_gate(gate::ANDN);
+			r.gt->concat(x, y);
+		}
+		return r;
+	}
+	int mid = (begin + end) / 2;
+	_cmp_result hi(_tree_compare(C, n, begin, mid, with_gt)), lo(_tree_compare(C, n, mid, end, with_gt));
+	auto merge = [&](gate* a, gate* b) {
+		gate* gand(C.new_gate(gate::AND)), * gor(C.new_gate(gate::OR));
+		gand->concat(hi.eq, b);
+		gor->concat(a, gand);
+		return gor;
+	};
+	_cmp_result r{ C.new_gate(gate::AND), merge(hi.lt, lo.lt), with_gt ? merge(hi.gt, lo.gt) : nullptr };
+	r.eq->concat(hi.eq, lo.eq);
+	return r;
+}
 
 compare_circuit::compare_circuit(int n)
 	: circuit(2 * n, 2)
@@ -6,32 +44,23 @@ compare_circuit::compare_circuit(int n)
 	std::vector<gate*> val[2];
 	for (int i(0); i != n; ++i) val[0].push_back(in[i]);
 	for (int i(n); i != 2 * n; ++i) val[1].push_back(in[i]);
-	gate* larger = new gate(gate::AND);
-	gate* lesser = new gate(gate::AND);
-	std::vector<gate*> nval[2];
-	for (int i(0); i != n; ++i) {
-		nval[0].push_back(new gate(gate::NOT));
-		nval[1].push_back(new gate(gate::NOT));
-	}
-	nval[0][0]->concat(val[0][0]);
-	nval[1][0]->concat(val[1][0]);
-	larger->concat(val[0][0], nval[1][0]);
-	lesser->concat(val[1][0], nval[0][0]);
+	gate* larger = new_gate(gate::ANDN);
+	gate* lesser = new_gate(gate::ANDN);
+	larger->concat(val[0][0], val[1][0]);
+	lesser->concat(val[1][0], val[0][0]);
 	for (int i(1); i != n; ++i) {
 		gate* newval[2];
 		gate* newand[2];
-		gate* newlarger(new gate(gate::OR)), *newlesser(new gate(gate::OR));
-		gate::init(newval, 2, gate::OR);
-		gate::init(newand, 2, gate::AND);
+		gate* newlarger(new_gate(gate::OR)), *newlesser(new_gate(gate::OR));
+		new_gates(newval, 2, gate::OR);
+		new_gates(newand, 2, gate::ANDN);
 
 		newval[0]->concat(val[0][i], larger);
 		newval[1]->concat(val[1][i], lesser);
 		val[0][i] = newval[0], val[1][i] = newval[1];
-		nval[0][i]->concat(val[0][i]);
-		nval[1][i]->concat(val[1][i]);
 
-		newand[0]->concat(val[0][i], nval[1][i]);
-		newand[1]->concat(val[1][i], nval[0][i]);
+		newand[0]->concat(val[0][i], val[1][i]);
+		newand[1]->concat(val[1][i], val[0][i]);
 		newlarger->concat(larger, newand[0]);
 		newlesser->concat(lesser, newand[1]);
 
@@ -100,30 +129,30 @@ less_circuit::less_circuit(int n)
 {
 	std::vector<gate*> gval;
 	for (int i(0); i != n; ++i) {
-		gate* gxor = new gate(gate::XOR);
+		gate* gxor = new_gate(gate::XOR);
 		gxor->concat(in[i], in[i + n]);
 		gval.push_back(gxor);
 	}
 	for (int i(1); i != n; ++i) {
-		gate* gor = new gate(gate::OR);
+		gate* gor = new_gate(gate::OR);
 		gor->concat(gval[i - 1], gval[i]);
 		gval[i] = gor;
 	}
 	std::vector<gate*> new_gval;
 	new_gval.push_back(gval[0]);
 	for (int i(1); i != n; ++i) {
-		gate* gxor = new gate(gate::XOR);
+		gate* gxor = new_gate(gate::XOR);
 		gxor->concat(gval[i - 1], gval[i]);
 		new_gval.push_back(gxor);
 	}
 	gval = std::move(new_gval);
 	for (int i(0); i != n; ++i) {
-		gate* gand = new gate(gate::AND);
+		gate* gand = new_gate(gate::AND);
 		gand->concat(gval[i], in[i + n]);
 		gval[i] = gand;
 	}
 	for (int i(1); i != n; ++i) {
-		gate* gor = new gate(gate::OR);
+		gate* gor = new_gate(gate::OR);
 		gor->concat(gval[i - 1], gval[i]);
 		gval[i] = gor;
 	}
@@ -160,4 +189,77 @@ void test_less() {
 	}
 	if (wronged) std::cout << "Compare circuit wronged." << std::endl;
 	else std::cout << "Compare circuit passed." << std::endl;
-}
\ No newline at end of file
+}
+
+tree_compare_circuit::tree_compare_circuit(int n)
+	: circuit(2 * n, 2)
+{
+	_cmp_result r(_tree_compare(*this, n, 0, n, true));
+	out[0] = r.lt;
+	out[1] = r.gt;
+	remove_void();
+}
+
+tree_less_circuit::tree_less_circuit(int n)
+	: circuit(2 * n, 1)
+{
+	out[0] = _tree_compare(*this, n, 0, n, false).lt;
+	remove_void();
+}
+
+void test_tree_comparison() {
+	bool wronged(false);
+	for (int n(1); n <= 40; ++n) {
+		compare_circuit C(n);
+		tree_compare_circuit T(n);
+		tree_less_circuit L(n);
+		T.check();
+		L.check();
+		for (int _(0); _ != 50; ++_) {
+			std::vector<bool> input;
+			for (int i(0); i != 2 * n; ++i) input.push_back(rand() % 2);
+			if (_ % 2) {
+				// make the inputs share a long common prefix
+				int common = rand() % n;
+				for (int i(0); i != common; ++i) input[i + n] = input[i];
+			}
+			auto expected = C.eval(input);
+			if (T.eval(input) != expected || L.eval(input)[0] != expected[0]) wronged = true;
+		}
+	}
+	std::cout << "n: compare size, depth -> tree | less size, depth -> tree" << std::endl;
+	for (int n : { 8, 32, 128, 512 }) {
+		compare_circuit C(n);
+		tree_compare_circuit T(n);
+		less_circuit L(n);
+		tree_less_circuit TL(n);
+		std::cout << n << ": " << C.size() << ", " << compiled_circuit(C).depth() << " -> " << T.size() << ", " << compiled_circuit(T).depth()
+			<< " | " << L.size() << ", " << compiled_circuit(L).depth() << " -> " << TL.size() << ", " << compiled_circuit(TL).depth() << std::endl;
+	}
+	{
+		const int n(100), l(32);
+		int logn(_count_bits(n));
+		kmin_options opt;
+		opt.comparator = kmin_options::TREE_COMPARATOR;
+		kmin_circuit R(n, l), K(n, l, opt);
+		K.check();
+		std::cout << "kmin_circuit(" << n << ", " << l << "): size " << R.size() << " -> " << K.size()
+			<< ", depth " << compiled_circuit(R).depth() << " -> " << compiled_circuit(K).depth() << std::endl;
+		std::vector<bool> val[n];
+		for (int _(0); _ != 100; ++_) {
+			std::vector<bool> input;
+			for (int i(0); i != n; ++i) {
+				val[i].clear();
+				for (int j(0); j != l; ++j) {
+					val[i].push_back(rand() % 2);
+					input.push_back(val[i].back());
+				}
+			}
+			int ik = rand() % n + 1;
+			for (int i(0); i != logn; ++i) input.push_back((ik >> (logn - i - 1)) & 1);
+			if (K.eval(input) != kmin(val, n, ik)) wronged = true;
+		}
+	}
+	if (wronged) std::cout << "Tree compare circuit wronged." << std::endl;
+	else std::cout << "Tree compare circuit passed." << std::endl;
+}
@@ -25,8 +25,33 @@ public:
     less_circuit(int n);
 };
 
+/*
+* Tree-structured versions of compare_circuit and less_circuit, with the same inputs and outputs.
+* 
+* Both halves of the inputs are compared recursively, and the results merged:
+*     eq = eq_hi AND eq_lo
+*     lt = lt_hi OR (eq_hi AND lt_lo)
+*     gt = gt_hi OR (eq_hi AND gt_lo)
+* so the depth is O(log n) (2 per level), and the size stays linear: about 5n for less, 7n for compare.
+*/
+class tree_compare_circuit :
+    public circuit
+{
+public:
+    tree_compare_circuit(int n);
+};
+
+class tree_less_circuit :
+    public circuit
+{
+public:
+    tree_less_circuit(int n);
+};
+
 void test_comparison();
 
 std::vector<bool> compare(std::vector<bool> x[], int n);
 
 void test_less();
+
+void test_tree_comparison();
@@ -0,0 +1,459 @@
+#include "compiled_circuit.h"
+#include "kmin_circuit.h"
+
+#include <unordered_map>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define KMC_NO_MMAP
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+* The arrays of a compiled_circuit built in memory.
+*/
+struct _compiled_storage {
+	std::vector<unsigned char> type;
+	std::vector<int> in0, in1, in2, level_begin, out;
+};
+
+compiled_circuit::compiled_circuit(const circuit& C) {
+	auto S = std::make_shared<_compiled_storage>();
+	std::vector<unsigned char>& type(S->type);
+	std::vector<int>& in0(S->in0), & in1(S->in1), & in2(S->in2), & level_begin(S->level_begin), & out(S->out);
+	// Kahn's algorithm, starting from the INPUT gates.
+	// The topological order found is then stably sorted by level.
+	std::unordered_map<const gate*, int> ready, index;
+	std::vector<const gate*> order;
+	std::vector<int> level;
+	for (const gate* g : C.in) {
+		if (g->type != gate::INPUT) throw "Input gate is not of type INPUT.";
+		index[g] = order.size();
+		order.push_back(g);
+		level.push_back(0);
+	}
+	for (const gate* g : C.roots()) {
+		if (g->type == gate::INPUT) continue;
+		// constant gates are on level 1, so that level 0 only holds INPUT gates.
+		index[g] = order.size();
+		order.push_back(g);
+		level.push_back(1);
+	}
+	for (int head(0); head != order.size(); ++head) {
+		const gate* now(order[head]);
+		for (const gate* g : now->output) {
+			int need = gate::arity(g->type);
+			if (++ready[g] != need) continue;
+			int lv(0);
+			for (int i(0); i != need; ++i) {
+				auto itr = index.find(g->input[i]);
+				if (itr == index.end()) throw "Input gate missing.";
+				lv = std::max(lv, level[itr->second] + 1);
+			}
+			index[g] = order.size();
+			order.push_back(g);
+			level.push_back(lv);
+		}
+	}
+
+	// Counting sort by level; INPUT gates stay in front, in the order of C.in.
+	int nlevel(0);
+	for (int lv : level) nlevel = std::max(nlevel, lv + 1);
+	level_begin.assign(nlevel + 1, 0);
+	for (int lv : level) ++level_begin[lv + 1];
+	for (int d(0); d != nlevel; ++d) level_begin[d + 1] += level_begin[d];
+	std::vector<int> pos(level_begin.begin(), level_begin.end() - 1);
+	std::vector<int> rank(order.size());
+	for (int i(0); i != order.size(); ++i) rank[i] = pos[level[i]]++;
+
+	type.resize(order.size());
+	in0.assign(order.size(), -1);
+	in1.assign(order.size(), -1);
+	in2.assign(order.size(), -1);
+	for (int i(0); i != order.size(); ++i) {
+		const gate* g(order[i]);
+		type[rank[i]] = g->type;
+		if (g->input[0]) in0[rank[i]] = rank[index[g->input[0]]];
+		if (g->input[1]) in1[rank[i]] = rank[index[g->input[1]]];
+		if (g->input[2]) in2[rank[i]] = rank[index[g->input[2]]];
+	}
+	for (const gate* g : C.out) {
+		auto itr = index.find(g);
+		if (itr == index.end()) throw "Output gate not reachable from input.";
+		out.push_back(rank[itr->second]);
+	}
+
+	this->type = type;
+	this->in0 = in0;
+	this->in1 = in1;
+	this->in2 = in2;
+	this->level_begin = level_begin;
+	this->out = out;
+	holder = S;
+}
+
+std::vector<bool> compiled_circuit::eval(const std::vector<bool>& input) const {
+	if (input.size() != fanin()) return {}; // invalid input.
+	if (out.empty()) return {}; // nothing to output.
+	std::vector<char> val(type.size());
+	int i(0);
+	for (; i != input.size(); ++i) val[i] = input[i];
+	for (; i != type.size(); ++i) {
+		gate::gate_type t = gate::gate_type(type[i]);
+		if (t == gate::INPUT || t >= gate::END_OF_TYPE) return {}; // ill-formed circuit.
+		int arity(gate::arity(t));
+		val[i] = gate::apply(t, arity > 0 && val[in0[i]], arity > 1 && val[in1[i]], arity > 2 && val[in2[i]]);
+	}
+	std::vector<bool> ret;
+	for (int g : out) ret.push_back(val[g]);
+	return ret;
+}
+
+void compiled_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words) const {
+	simd_eval(*this, input, output, words, detect_simd());
+}
+
+void compiled_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words, simd_level level) const {
+	simd_eval(*this, input, output, words, level);
+}
+
+std::vector<uint64_t> compiled_circuit::eval_batch(const std::vector<uint64_t>& input) const {
+	if (fanin() == 0 || input.empty() || input.size() % fanin()) return {}; // invalid input.
+	int words = input.size() / fanin();
+	std::vector<uint64_t> ret(out.size() * words);
+	eval_batch(input.data(), ret.data(), words);
+	return ret;
+}
+
+int compiled_circuit::gate_count() const {
+	return type.size();
+}
+
+int compiled_circuit::size() const {
+	int sz(0);
+	for (unsigned char t : type) {
+		if (gate::arity(gate::gate_type(t)) > 1) ++sz;
+	}
+	return sz;
+}
+
+int compiled_circuit::depth() const {
+	return level_begin.empty() ? 0 : int(level_begin.size()) - 2;
+}
+
+int compiled_circuit::fanin() const {
+	return level_begin.size() < 2 ? 0 : level_begin[1];
+}
+
+int compiled_circuit::fanout() const {
+	return out.size();
+}
+
+static const char _netlist_magic[4] = { 'K', 'M', 'C', 'N' };
+static const uint32_t _netlist_version = 2;
+
+void compiled_circuit::save(std::ostream& stream) const {
+	static_assert(sizeof(int) == sizeof(int32_t), "int must be 32-bit.");
+	uint32_t header[5] = { _netlist_version, uint32_t(gate_count()), uint32_t(fanin()), uint32_t(fanout()),
+		uint32_t(level_begin.size() - 1) };
+	stream.write(_netlist_magic, 4);
+	stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(level_begin.data()), level_begin.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(out.data()), out.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(in0.data()), in0.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(in1.data()), in1.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(in2.data()), in2.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(type.data()), type.size());
+}
+
+void compiled_circuit::save(const std::string& path) const {
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream) throw "Cannot open file.";
+	save(stream);
+	if (!stream) throw "Failed to write file.";
+}
+
+compiled_circuit compiled_circuit::load(const std::string& path) {
+	const char* base(nullptr);
+	size_t len(0);
+	compiled_circuit ret;
+#ifdef KMC_NO_MMAP
+	std::ifstream stream(path, std::ios::binary | std::ios::ate);
+	if (!stream) throw "Cannot open file.";
+	auto buf = std::make_shared<std::vector<char>>(size_t(stream.tellg()));
+	stream.seekg(0);
+	stream.read(buf->data(), buf->size());
+	if (!stream) throw "Failed to read file.";
+	base = buf->data();
+	len = buf->size();
+	ret.holder = buf;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw "Cannot open file.";
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw "Failed to read file.";
+	}
+	len = st.st_size;
+	void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) throw "Failed to map file.";
+	base = static_cast<const char*>(addr);
+	ret.holder = std::shared_ptr<const void>(addr, [len](const void* p) { munmap(const_cast<void*>(p), len); });
+#endif
+
+	uint32_t header[5];
+	if (len < 4 + sizeof(header) || std::memcmp(base, _netlist_magic, 4) != 0) throw "Not a netlist file.";
+	std::memcpy(header, base + 4, sizeof(header));
+	if (header[0] != 1 && header[0] != _netlist_version) throw "Unsupported netlist version.";
+	size_t ngate(header[1]), nout(header[3]), nlevel(header[4]), nin(header[0] == 1 ? 2 : 3);
+	size_t expect = 4 + sizeof(header) + (nlevel + 1 + nout + nin * ngate) * sizeof(int32_t) + ngate;
+	if (len != expect) throw "Truncated netlist file.";
+	const char* p = base + 4 + sizeof(header);
+	auto take = [&p](size_t n) {
+		const int* ret = reinterpret_cast<const int*>(p);
+		p += n * sizeof(int32_t);
+		return array_view<int>(ret, n);
+	};
+	ret.level_begin = take(nlevel + 1);
+	ret.out = take(nout);
+	ret.in0 = take(ngate);
+	ret.in1 = take(ngate);
+	if (nin == 3) ret.in2 = take(ngate);
+	else {
+		// version 1: no third input; keep the filled in2 alive along with the mapping.
+		auto in2 = std::make_shared<std::pair<std::shared_ptr<const void>, std::vector<int>>>(ret.holder, std::vector<int>(ngate, -1));
+		ret.in2 = in2->second;
+		ret.holder = in2;
+	}
+	ret.type = array_view<unsigned char>(reinterpret_cast<const unsigned char*>(p), ngate);
+	if (ret.fanin() != header[2]) throw "Inconsistent netlist file.";
+	ret.verify();
+	return ret;
+}
+
+compiled_circuit compiled_circuit::assemble(std::vector<unsigned char>&& type, std::vector<int>&& in0, std::vector<int>&& in1,
+	std::vector<int>&& in2, std::vector<int>&& level_begin, std::vector<int>&& out) {
+	auto S = std::make_shared<_compiled_storage>();
+	S->type = std::move(type);
+	S->in0 = std::move(in0);
+	S->in1 = std::move(in1);
+	S->in2 = std::move(in2);
+	S->level_begin = std::move(level_begin);
+	S->out = std::move(out);
+	compiled_circuit C;
+	C.type = S->type;
+	C.in0 = S->in0;
+	C.in1 = S->in1;
+	C.in2 = S->in2;
+	C.level_begin = S->level_begin;
+	C.out = S->out;
+	C.holder = S;
+	C.verify();
+	return C;
+}
+
+void compiled_circuit::verify() const {
+	if (level_begin.size() < 2 || level_begin[0] != 0 || level_begin.back() != type.size()) throw "Invalid levels.";
+	if (in0.size() != type.size() || in1.size() != type.size() || in2.size() != type.size()) throw "Invalid netlist.";
+	for (int d(0); d + 1 != level_begin.size(); ++d) {
+		int begin(level_begin[d]), end(level_begin[d + 1]);
+		if (begin > end) throw "Invalid levels.";
+		for (int g(begin); g != end; ++g) {
+			if (d == 0) {
+				if (type[g] != gate::INPUT || in0[g] != -1 || in1[g] != -1 || in2[g] != -1) throw "Invalid INPUT gate.";
+				continue;
+			}
+			if (type[g] == gate::INPUT || type[g] >= gate::END_OF_TYPE) throw "Invalid gate type.";
+			// the first arity inputs must be on a lower level, the rest unconnected.
+			int arity(gate::arity(gate::gate_type(type[g])));
+			const int ins[3] = { in0[g], in1[g], in2[g] };
+			for (int i(0); i != 3; ++i) {
+				if (i >= arity) {
+					if (ins[i] != -1) {
+						if (arity == 0) throw "Invalid constant gate.";
+						if (arity == 1) throw "Invalid NOT gate.";
+						throw "Invalid gate input.";
+					}
+				} else if (ins[i] < 0 || ins[i] >= begin) {
+					throw (arity == 1 ? "Invalid NOT gate." : "Invalid gate input.");
+				}
+			}
+		}
+	}
+	for (int g : out) {
+		if (g < 0 || g >= type.size()) throw "Invalid output gate.";
+	}
+}
+
+std::vector<uint64_t> pack_lanes(const std::vector<std::vector<bool>>& vectors) {
+	if (vectors.empty()) return {};
+	int width = vectors[0].size(), words = (vectors.size() + 63) / 64;
+	std::vector<uint64_t> ret(width * words, 0);
+	for (int j(0); j != vectors.size(); ++j) {
+		if (vectors[j].size() != width) throw "Input of different length";
+		for (int i(0); i != width; ++i) {
+			if (vectors[j][i]) ret[i * words + j / 64] |= uint64_t(1) << (j % 64);
+		}
+	}
+	return ret;
+}
+
+std::vector<std::vector<bool>> unpack_lanes(const std::vector<uint64_t>& words, int width, int count) {
+	if (width == 0) return std::vector<std::vector<bool>>(count);
+	int nword = words.size() / width;
+	if (count > nword * 64) throw "Not enough lanes.";
+	std::vector<std::vector<bool>> ret(count, std::vector<bool>(width));
+	for (int j(0); j != count; ++j) {
+		for (int i(0); i != width; ++i) {
+			ret[j][i] = (words[i * nword + j / 64] >> (j % 64)) & 1;
+		}
+	}
+	return ret;
+}
+
+void test_netlist_file() {
+	const int n(256), l(128);
+	const std::string path("kmin_circuit.kmcn");
+	compiled_circuit CC;
+	{
+		kmin_circuit C(n, l);
+		CC = compiled_circuit(C);
+	}
+	auto t0 = std::chrono::steady_clock::now();
+	CC.save(path);
+	auto t1 = std::chrono::steady_clock::now();
+	compiled_circuit LC = compiled_circuit::load(path);
+	auto t2 = std::chrono::steady_clock::now();
+	std::cout << CC.gate_count() << " gates: save " << std::chrono::duration<double>(t1 - t0).count() * 1e3
+		<< " ms, load " << std::chrono::duration<double>(t2 - t1).count() * 1e3 << " ms" << std::endl;
+
+	bool wrong(LC.gate_count() != CC.gate_count() || LC.depth() != CC.depth());
+	std::vector<uint64_t> input(CC.fanin() * 8);
+	for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	if (LC.eval_batch(input) != CC.eval_batch(input)) wrong = true;
+	std::remove(path.c_str());
+	if (wrong) std::cout << "test_netlist_file: wrong." << std::endl;
+	else std::cout << "test_netlist_file: passed." << std::endl;
+}
+
+void test_compiled_circuit() {
+	const int n(100), l(128), rounds(200);
+	int logn(_count_bits(n));
+	kmin_circuit C(n, l);
+	C.check();
+	compiled_circuit CC(C);
+	std::cout << "gates: " << CC.gate_count() << ", size: " << CC.size() << ", depth: " << CC.depth() << std::endl;
+
+	std::vector<std::vector<bool>> inputs(rounds);
+	for (auto& input : inputs) {
+		for (int i(0); i != n * l; ++i) input.push_back(rand() % 2);
+		int ik = rand() % n + 1;
+		for (int i(0); i != logn; ++i) input.push_back((ik >> (logn - i - 1)) & 1);
+	}
+
+	bool wrong(false);
+	std::vector<std::vector<bool>> ret[2];
+	auto t0 = std::chrono::steady_clock::now();
+	for (auto& input : inputs) ret[0].push_back(C.eval(input));
+	auto t1 = std::chrono::steady_clock::now();
+	for (auto& input : inputs) ret[1].push_back(CC.eval(input));
+	auto t2 = std::chrono::steady_clock::now();
+	for (int i(0); i != rounds; ++i) {
+		if (ret[0][i] != ret[1][i]) wrong = true;
+	}
+	double sec[2] = {
+		std::chrono::duration<double>(t1 - t0).count(),
+		std::chrono::duration<double>(t2 - t1).count()
+	};
+	std::cout << "circuit::eval:          " << rounds / sec[0] << " vectors/s" << std::endl;
+	std::cout << "compiled_circuit::eval: " << rounds / sec[1] << " vectors/s" << std::endl;
+	if (wrong) std::cout << "test_compiled_circuit: wrong." << std::endl;
+	else std::cout << "test_compiled_circuit: passed." << std::endl;
+}
+
+/*
+* Compare eval_batch against circuit::eval on random input.
+*/
+static bool _check_batch(circuit& C, int count) {
+	C.check();
+	compiled_circuit CC(C);
+	std::vector<std::vector<bool>> inputs(count);
+	for (auto& input : inputs) {
+		for (int i(0); i != C.in.size(); ++i) input.push_back(rand() % 2);
+	}
+	auto ret = unpack_lanes(CC.eval_batch(pack_lanes(inputs)), CC.fanout(), count);
+	for (int j(0); j != count; ++j) {
+		if (ret[j] != C.eval(inputs[j])) return false;
+	}
+	return true;
+}
+
+void test_eval_batch() {
+	bool wrong(false);
+	{
+		adder_circuit C;
+		wrong |= !_check_batch(C, 64);
+	}
+	{
+		bitadder_circuit C(37);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		compare_circuit C(20);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		less_circuit C(20);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		int_adder C(10);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		exint_adder C(10);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		selector C(20);
+		wrong |= !_check_batch(C, 100);
+	}
+	{
+		// k must be in [1, n], so we check against the software kmin instead.
+		const int n(100), l(32), count(2000);
+		int logn(_count_bits(n));
+		kmin_circuit C(n, l);
+		C.check();
+		compiled_circuit CC(C);
+		std::vector<std::vector<bool>> inputs(count), val(count * n);
+		std::vector<int> ik(count);
+		for (int _(0); _ != count; ++_) {
+			for (int i(0); i != n; ++i) {
+				for (int j(0); j != l; ++j) {
+					val[_ * n + i].push_back(rand() % 2);
+					inputs[_].push_back(val[_ * n + i][j]);
+				}
+			}
+			ik[_] = rand() % n + 1;
+			for (int i(0); i != logn; ++i) inputs[_].push_back((ik[_] >> (logn - i - 1)) & 1);
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		auto ret = unpack_lanes(CC.eval_batch(pack_lanes(inputs)), l, count);
+		auto t1 = std::chrono::steady_clock::now();
+		std::cout << "kmin_circuit(" << n << ", " << l << "): " << count / std::chrono::duration<double>(t1 - t0).count() << " vectors/s" << std::endl;
+		for (int _(0); _ != count; ++_) {
+			if (ret[_] != kmin(&val[_ * n], n, ik[_])) wrong = true;
+		}
+	}
+	if (wrong) std::cout << "test_eval_batch: wrong." << std::endl;
+	else std::cout << "test_eval_batch: passed." << std::endl;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include "circuit.h"
+#include "simd_kernel.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/*
+* A read-only view of an array owned by someone else (a vector, or a mapped file).
+*/
+template <class T>
+class array_view {
+public:
+	array_view() = default;
+	array_view(const T* ptr, size_t len) : ptr(ptr), len(len) {}
+	array_view(const std::vector<T>& v) : ptr(v.data()), len(v.size()) {}
+
+	const T& operator[](size_t i) const { return ptr[i]; }
+	const T* data() const { return ptr; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + len; }
+	const T& back() const { return ptr[len - 1]; }
+
+private:
+	const T* ptr = nullptr;
+	size_t len = 0;
+};
+
+/*
+* A compiled_circuit is a flat, read-only snapshot of a well-formed circuit.
+*
+* The gates are sorted topologically and grouped by level (the length of the longest path from an INPUT gate),
+* and are stored as a structure of arrays:
+*     type[i]            the gate type of gate i
+*     in0[i], in1[i]     the indices of its input gates (-1 if not connected)
+*     in2[i]             the index of its third input gate, for MUX and MAJ (-1 otherwise)
+*
+* Gate i < in.size() is the i-th INPUT gate, so the input vector can be copied in directly.
+* Every other gate only refers to gates with smaller index, thus evaluation is one linear sweep:
+* no queue, no counters and no pointer chasing.
+*
+* The compiled_circuit does not refer to the circuit it is built from; the circuit can be destroyed afterwards.
+* The arrays are immutable and shared: copying a compiled_circuit is cheap, and the arrays may also live in a
+* memory-mapped netlist file (see load).
+*/
+class compiled_circuit {
+public:
+	compiled_circuit() = default;
+
+	/*
+	* Compile C. C must be well-formed (see circuit::check).
+	*/
+	explicit compiled_circuit(const circuit& C);
+
+	/*
+	* Same as circuit::eval, but it does not modify any state, so it is safe to call it concurrently.
+	*/
+	std::vector<bool> eval(const std::vector<bool>& input) const;
+
+	/*
+	* Evaluate 64 * words input vectors at once; each gate holds one uint64_t per 64 vectors (one vector per bit, "lane").
+	* The buffers are lane-packed: the words of the i-th input wire are input[i * words, (i + 1) * words),
+	* and likewise for the output, i.e. output must have room for fanout() * words words.
+	* It runs on the widest SIMD level the CPU supports (see simd_kernel.h).
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words) const;
+
+	/*
+	* Same as above, but on the given SIMD level.
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words, simd_level level) const;
+
+	/*
+	* input.size() must be a multiple of fanin(); returns {} on invalid input.
+	*/
+	std::vector<uint64_t> eval_batch(const std::vector<uint64_t>& input) const;
+
+	/*
+	* Number of gates, including INPUT gates.
+	*/
+	int gate_count() const;
+
+	/*
+	* Count the size the same way as circuit::size, i.e. without NOT and INPUT gates.
+	*/
+	int size() const;
+
+	/*
+	* Number of levels; INPUT gates are on level 0.
+	*/
+	int depth() const;
+
+	int fanin() const;
+	int fanout() const;
+
+	/*
+	* Write the netlist in the binary format (see load).
+	*/
+	void save(std::ostream& stream) const;
+	void save(const std::string& path) const;
+
+	/*
+	* Load a netlist written by save. The file is memory-mapped (where the platform allows),
+	* and evaluated directly from the mapping: there is no per-gate allocation.
+	* The file is checked to be a valid topologically sorted netlist in linear time; otherwise it throws.
+	*
+	* The format (native endianness, 32-bit little-endian on all supported platforms):
+	*     char[4]  "KMCN"
+	*     uint32   version (= 2)
+	*     uint32   gate count, fan-in, fan-out, level count
+	*     int32    level_begin[level count + 1]
+	*     int32    out[fan-out]              the output index table
+	*     int32    in0[gate count], in1[gate count], in2[gate count]
+	*     uint8    type[gate count]
+	* The input index table is implicit: gates [0, fan-in) are the INPUT gates, in order.
+	* Version 1 files (without in2, and thus without MUX and MAJ gates) are still accepted.
+	*/
+	static compiled_circuit load(const std::string& path);
+
+	/*
+	* Take over the arrays of a netlist built elsewhere (see netlist_builder); they are verified as load does.
+	*/
+	static compiled_circuit assemble(std::vector<unsigned char>&& type, std::vector<int>&& in0, std::vector<int>&& in1,
+		std::vector<int>&& in2, std::vector<int>&& level_begin, std::vector<int>&& out);
+
+	array_view<unsigned char> type;
+	array_view<int> in0, in1, in2;
+
+	/*
+	* Gates on level d are [level_begin[d], level_begin[d + 1]).
+	*/
+	array_view<int> level_begin;
+
+	/*
+	* out[j] is the index of the j-th output gate.
+	*/
+	array_view<int> out;
+
+protected:
+	/*
+	* Check the arrays bound by the views; throws if they do not form a topologically sorted netlist.
+	*/
+	void verify() const;
+
+	/*
+	* Keeps the memory the views point into alive.
+	*/
+	std::shared_ptr<const void> holder;
+};
+
+/*
+* Pack vectors (of the same length) into lane-packed words, as taken by compiled_circuit::eval_batch.
+* Vector j goes to bit (j % 64) of word j / 64; unused lanes are 0.
+*/
+std::vector<uint64_t> pack_lanes(const std::vector<std::vector<bool>>& vectors);
+
+/*
+* The inverse of pack_lanes: unpack count many vectors of the given width.
+*/
+std::vector<std::vector<bool>> unpack_lanes(const std::vector<uint64_t>& words, int width, int count);
+
+void test_compiled_circuit();
+
+void test_netlist_file();
+
+void test_eval_batch();
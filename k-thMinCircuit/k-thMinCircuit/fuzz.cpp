@@ -0,0 +1,411 @@
+#include "fuzz.h"
+#include "adder_circuit.h"
+#include "bitadder_circuit.h"
+#include "int_adder.h"
+#include "prefix_adder.h"
+#include "compare_circuit.h"
+#include "selector.h"
+#include "kmin_circuit.h"
+#include "netlist_builder.h"
+#include "parallel_eval.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+const char* fuzz_name(fuzz_generator g) {
+	static const char* names[] = { "adder", "bitadder", "csa_bitadder", "int_adder", "exint_adder", "prefix_int_adder",
+		"prefix_exint_adder", "compare", "less", "tree_compare", "tree_less", "selector", "kmin_circuit", "kmin_circuit/fast",
+		"build_kmin", "kmin_hier" };
+	return g >= 0 && g < END_OF_FUZZ ? names[g] : "unknown";
+}
+
+static bool _is_kmin(fuzz_generator g) {
+	return g == FUZZ_KMIN || g == FUZZ_KMIN_FAST || g == FUZZ_BUILD_KMIN || g == FUZZ_KMIN_HIER;
+}
+
+compiled_circuit fuzz_target::build() const {
+	switch (generator) {
+	case FUZZ_ADDER:
+		return compiled_circuit(adder_circuit());
+	case FUZZ_BITADDER:
+		return compiled_circuit(bitadder_circuit(n));
+	case FUZZ_CSA_BITADDER:
+		return compiled_circuit(csa_bitadder_circuit(n));
+	case FUZZ_INT_ADDER:
+		return compiled_circuit(int_adder(n));
+	case FUZZ_EXINT_ADDER:
+		return compiled_circuit(exint_adder(n));
+	case FUZZ_PREFIX_INT_ADDER:
+		return compiled_circuit(prefix_int_adder(n));
+	case FUZZ_PREFIX_EXINT_ADDER:
+		return compiled_circuit(prefix_exint_adder(n));
+	case FUZZ_COMPARE:
+		return compiled_circuit(compare_circuit(n));
+	case FUZZ_LESS:
+		return compiled_circuit(less_circuit(n));
+	case FUZZ_TREE_COMPARE:
+		return compiled_circuit(tree_compare_circuit(n));
+	case FUZZ_TREE_LESS:
+		return compiled_circuit(tree_less_circuit(n));
+	case FUZZ_SELECTOR:
+		return compiled_circuit(selector(n));
+	case FUZZ_KMIN:
+		return compiled_circuit(kmin_circuit(n, l));
+	case FUZZ_KMIN_FAST: {
+		kmin_options opt;
+		opt.popcount = kmin_options::CSA_POPCOUNT;
+		opt.adder = kmin_options::PREFIX_ADDER;
+		opt.comparator = kmin_options::TREE_COMPARATOR;
+		return compiled_circuit(kmin_circuit(n, l, opt));
+	}
+	case FUZZ_BUILD_KMIN:
+		return build_kmin(n, l);
+	case FUZZ_KMIN_HIER:
+		return compiled_circuit(flattened_circuit(kmin_hier(n, l)));
+	default:
+		throw "Unknown generator.";
+	}
+}
+
+std::vector<int> fuzz_target::widths() const {
+	switch (generator) {
+	case FUZZ_ADDER:
+		return { 1, 1, 1 };
+	case FUZZ_BITADDER:
+	case FUZZ_CSA_BITADDER: {
+		// the n input bits, 64 to a field
+		std::vector<int> ret(n / 64, 64);
+		if (n % 64) ret.push_back(n % 64);
+		return ret;
+	}
+	case FUZZ_SELECTOR:
+		return { n, n, 1 };
+	default:
+		if (_is_kmin(generator)) {
+			std::vector<int> ret(n, l);
+			ret.push_back(_count_bits(n));
+			return ret;
+		}
+		return { n, n };
+	}
+}
+
+/*
+* The low w bits of v, MSB first, appended to bits.
+*/
+static void _push_bits(std::vector<bool>& bits, uint64_t v, int w) {
+	for (int i(w - 1); i >= 0; --i) bits.push_back((v >> i) & 1);
+}
+
+std::vector<bool> fuzz_target::oracle(const std::vector<uint64_t>& f) const {
+	std::vector<bool> ret;
+	uint64_t mask(n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1);
+	switch (generator) {
+	case FUZZ_ADDER:
+		return { bool((f[0] ^ f[1] ^ f[2]) & 1), f[0] + f[1] + f[2] >= 2 };
+	case FUZZ_BITADDER:
+	case FUZZ_CSA_BITADDER: {
+		int cnt(0);
+		for (uint64_t v : f) {
+			for (; v; v &= v - 1) ++cnt;
+		}
+		for (int i(0); i != _count_bits(n); ++i) ret.push_back((cnt >> i) & 1); // small endian
+		return ret;
+	}
+	case FUZZ_INT_ADDER:
+	case FUZZ_PREFIX_INT_ADDER:
+		_push_bits(ret, (f[0] + f[1]) & mask, n);
+		return ret;
+	case FUZZ_EXINT_ADDER:
+	case FUZZ_PREFIX_EXINT_ADDER:
+		ret.push_back(n == 64 ? f[0] + f[1] < f[0] : ((f[0] + f[1]) >> n) & 1);
+		_push_bits(ret, (f[0] + f[1]) & mask, n);
+		return ret;
+	case FUZZ_COMPARE:
+	case FUZZ_TREE_COMPARE:
+		return { f[0] < f[1], f[0] > f[1] };
+	case FUZZ_LESS:
+	case FUZZ_TREE_LESS:
+		return { f[0] < f[1] };
+	case FUZZ_SELECTOR:
+		_push_bits(ret, f[2] ? f[1] : f[0], n);
+		return ret;
+	default: {
+		std::vector<uint64_t> v(f.begin(), f.begin() + n);
+		std::nth_element(v.begin(), v.begin() + (f[n] - 1), v.end());
+		_push_bits(ret, v[f[n] - 1], l);
+		return ret;
+	}
+	}
+}
+
+bool fuzz_target::valid(const std::vector<uint64_t>& f) const {
+	auto w = widths();
+	if (f.size() != w.size()) return false;
+	for (int i(0); i != f.size(); ++i) {
+		if (w[i] < 64 && (f[i] >> w[i])) return false;
+	}
+	if (_is_kmin(generator)) return f[n] >= 1 && f[n] <= uint64_t(n);
+	return true;
+}
+
+std::string fuzz_target::name() const {
+	std::ostringstream s;
+	s << fuzz_name(generator) << "(" << n;
+	if (_is_kmin(generator)) s << ", " << l;
+	s << ")";
+	return s.str();
+}
+
+std::string fuzz_failure::describe() const {
+	std::ostringstream s;
+	s << target.name() << ": fields {";
+	for (int i(0); i != fields.size(); ++i) s << (i ? ", " : "") << fields[i];
+	s << "}: expected ";
+	for (bool b : expected) s << b;
+	s << ", got ";
+	for (bool b : got) s << b;
+	return s.str();
+}
+
+/*
+* splitmix64: a small seedable generator, so that a batch can be regenerated from (seed, batch, lane) alone.
+*/
+struct _rng {
+	uint64_t state;
+	explicit _rng(uint64_t seed) : state(seed) {}
+	uint64_t next() {
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	uint64_t below(uint64_t m) {
+		return next() % m;
+	}
+};
+
+/*
+* The fields of one input vector.
+*/
+static std::vector<uint64_t> _generate(const fuzz_target& T, const std::vector<int>& w, _rng& r, bool adversarial) {
+	int m(w.size()), values(_is_kmin(T.generator) ? T.n : (T.generator == FUZZ_SELECTOR ? 2 : m));
+	std::vector<uint64_t> f(m);
+	auto mask = [&](int i) {
+		return w[i] >= 64 ? ~uint64_t(0) : (uint64_t(1) << w[i]) - 1;
+	};
+	int mode(adversarial ? int(r.below(5)) : 0);
+	uint64_t same(r.next());
+	for (int i(0); i != values; ++i) {
+		switch (mode) {
+		case 1: // all equal
+			f[i] = same & mask(i);
+			break;
+		case 2: // 0 or all ones
+			f[i] = r.below(2) ? mask(i) : 0;
+			break;
+		case 3: // few distinct values, i.e. many ties
+			f[i] = r.below(3) & mask(i);
+			break;
+		case 4: // near the maximum
+			f[i] = (mask(i) - r.below(3)) & mask(i);
+			break;
+		default:
+			f[i] = r.next() & mask(i);
+			break;
+		}
+	}
+	for (int i(values); i != m; ++i) f[i] = r.next() & mask(i);
+	if (_is_kmin(T.generator)) {
+		uint64_t c(adversarial ? r.below(4) : 3);
+		f[T.n] = (c == 0 ? 1 : (c == 1 ? T.n : r.below(T.n) + 1));
+	}
+	return f;
+}
+
+static uint64_t _lane_seed(uint64_t seed, const fuzz_target& T, int batch, int lane) {
+	_rng r(seed ^ (uint64_t(T.generator) << 56) ^ (uint64_t(T.n) << 36) ^ (uint64_t(T.l) << 24));
+	r.state ^= r.next() + (uint64_t(batch) << 20) + uint64_t(lane);
+	return r.next();
+}
+
+static std::vector<bool> _bits(const std::vector<uint64_t>& f, const std::vector<int>& w) {
+	std::vector<bool> ret;
+	for (int i(0); i != f.size(); ++i) _push_bits(ret, f[i], w[i]);
+	return ret;
+}
+
+/*
+* The outputs of C on one input vector, through eval_batch as in the fuzzing itself: the vector in lane 0 of a batch
+* of one word. compiled_circuit::eval takes another path, which could hide (or show) a different bug.
+*/
+static std::vector<bool> _eval_lane0(const compiled_circuit& C, const std::vector<bool>& input) {
+	std::vector<uint64_t> in(input.begin(), input.end()), out(C.fanout());
+	C.eval_batch(in.data(), out.data(), 1);
+	std::vector<bool> ret;
+	for (uint64_t x : out) ret.push_back(x & 1);
+	return ret;
+}
+
+/*
+* Greedy shrinking: try to replace one field by a smaller value, as long as the input stays legal and still fails.
+*/
+static void _shrink(fuzz_failure& F, const compiled_circuit& C) {
+	auto w = F.target.widths();
+	auto fails = [&](const std::vector<uint64_t>& f) {
+		return F.target.valid(f) && _eval_lane0(C, _bits(f, w)) != F.target.oracle(f);
+	};
+	for (bool changed(true); changed; ) {
+		changed = false;
+		for (int i(0); i != F.fields.size(); ++i) {
+			for (bool again(true); again; ) {
+				again = false;
+				uint64_t v(F.fields[i]);
+				if (v == 0) break;
+				// 0, half, each set bit cleared (the highest first), minus one
+				std::vector<uint64_t> cand{ 0, v >> 1 };
+				for (int b(63); b >= 0; --b) {
+					if ((v >> b) & 1) cand.push_back(v & ~(uint64_t(1) << b));
+				}
+				cand.push_back(v - 1);
+				for (uint64_t c : cand) {
+					std::vector<uint64_t> g(F.fields);
+					g[i] = c;
+					if (fails(g)) {
+						F.fields = g;
+						changed = again = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+	F.expected = F.target.oracle(F.fields);
+	F.got = _eval_lane0(C, _bits(F.fields, w));
+}
+
+fuzz_report fuzz(const fuzz_target& T, const compiled_circuit& C, const fuzz_options& opt) {
+	auto w = T.widths();
+	int fanin(0);
+	for (int x : w) fanin += x;
+	if (fanin != C.fanin() || T.oracle(std::vector<uint64_t>(w.size(), 1)).size() != C.fanout()) {
+		throw "The circuit does not match the target.";
+	}
+	fuzz_report R;
+	const int words(opt.words), lanes(64 * words), fout(C.fanout());
+	thread_pool pool(opt.threads);
+	std::mutex mtx;
+	int first(-1); // the first failing (batch * lanes + lane)
+	auto t0 = std::chrono::steady_clock::now();
+	pool.run(opt.batches, [&](int batch, int) {
+		std::vector<uint64_t> in(size_t(fanin) * words, 0), expect(size_t(fout) * words, 0), out(expect.size());
+		for (int lane(0); lane != lanes; ++lane) {
+			_rng r(_lane_seed(opt.seed, T, batch, lane));
+			auto f = _generate(T, w, r, opt.adversarial);
+			auto ans = T.oracle(f);
+			int wd(lane / 64);
+			uint64_t b(uint64_t(1) << (lane % 64));
+			for (int i(0), j(0); i != f.size(); ++i) {
+				for (int k(w[i] - 1); k >= 0; --k, ++j) {
+					if ((f[i] >> k) & 1) in[size_t(j) * words + wd] |= b;
+				}
+			}
+			for (int j(0); j != fout; ++j) {
+				if (ans[j]) expect[size_t(j) * words + wd] |= b;
+			}
+		}
+		C.eval_batch(in.data(), out.data(), words);
+		// compare whole words; only a failing lane is looked at
+		int bad(-1);
+		for (int j(0); j != fout; ++j) {
+			for (int wd(0); wd != words; ++wd) {
+				uint64_t diff(out[size_t(j) * words + wd] ^ expect[size_t(j) * words + wd]);
+				if (!diff) continue;
+				int lane(wd * 64);
+				while (!(diff & 1)) diff >>= 1, ++lane;
+				if (bad < 0 || lane < bad) bad = lane;
+			}
+		}
+		if (bad >= 0) {
+			std::lock_guard<std::mutex> lock(mtx);
+			if (first < 0 || batch * lanes + bad < first) first = batch * lanes + bad;
+		}
+	});
+	R.checks = (long long)opt.batches * lanes;
+	R.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	if (first >= 0) {
+		_rng r(_lane_seed(opt.seed, T, first / lanes, first % lanes));
+		fuzz_failure F;
+		F.target = T;
+		F.fields = _generate(T, w, r, opt.adversarial);
+		_shrink(F, C);
+		R.failures.push_back(F);
+	}
+	return R;
+}
+
+std::vector<fuzz_target> fuzz_targets() {
+	std::vector<fuzz_target> ret;
+	ret.push_back({ FUZZ_ADDER, 1, 0 });
+	for (fuzz_generator g : { FUZZ_BITADDER, FUZZ_CSA_BITADDER }) {
+		for (int p(2); p <= 1024; p *= 2) {
+			for (int n : { p - 1, p, p + 1 }) {
+				if (n >= 2 && (ret.back().generator != g || n > ret.back().n)) ret.push_back({ g, n, 0 });
+			}
+		}
+	}
+	for (int g(FUZZ_INT_ADDER); g <= FUZZ_SELECTOR; ++g) {
+		for (int n : { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64 }) ret.push_back({ fuzz_generator(g), n, 0 });
+	}
+	for (int g(FUZZ_KMIN); g <= FUZZ_KMIN_HIER; ++g) {
+		for (int n : { 2, 3, 4, 5, 7, 8, 9, 16, 17, 31, 32, 33 }) {
+			for (int l : { 1, 3, 8 }) ret.push_back({ fuzz_generator(g), n, l });
+		}
+	}
+	return ret;
+}
+
+fuzz_report fuzz_all(const fuzz_options& opt) {
+	fuzz_report R;
+	for (const fuzz_target& T : fuzz_targets()) {
+		auto r = fuzz(T, T.build(), opt);
+		R.checks += r.checks;
+		R.seconds += r.seconds;
+		R.failures.insert(R.failures.end(), r.failures.begin(), r.failures.end());
+	}
+	return R;
+}
+
+void test_fuzz() {
+	bool wrong(false);
+	fuzz_options opt;
+	auto t0 = std::chrono::steady_clock::now();
+	fuzz_report R = fuzz_all(opt);
+	double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::cout << fuzz_targets().size() << " targets, " << R.checks << " checks in " << R.seconds << " s ("
+		<< R.checks / R.seconds << " checks/s; " << total << " s with building)" << std::endl;
+	for (auto& F : R.failures) std::cout << "    " << F.describe() << std::endl;
+	if (!R.failures.empty()) wrong = true;
+	{
+		// a planted bug: the top carry of int_adder(16) is computed by OR instead of XOR somewhere.
+		fuzz_target T{ FUZZ_INT_ADDER, 16, 0 };
+		compiled_circuit C(T.build());
+		std::vector<unsigned char> type(C.type.begin(), C.type.end());
+		for (int g(C.gate_count() - 1); g >= 0; --g) {
+			if (type[g] == gate::XOR) {
+				type[g] = gate::OR;
+				break;
+			}
+		}
+		compiled_circuit B(compiled_circuit::assemble(std::move(type), std::vector<int>(C.in0.begin(), C.in0.end()),
+			std::vector<int>(C.in1.begin(), C.in1.end()), std::vector<int>(C.in2.begin(), C.in2.end()),
+			std::vector<int>(C.level_begin.begin(), C.level_begin.end()),
+			std::vector<int>(C.out.begin(), C.out.end())));
+		auto r = fuzz(T, B, opt);
+		if (r.failures.empty()) wrong = true;
+		else std::cout << "planted bug: " << r.failures[0].describe() << std::endl;
+	}
+	if (wrong) std::cout << "test_fuzz: wrong." << std::endl;
+	else std::cout << "test_fuzz: passed." << std::endl;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+* The generators the fuzzer knows an oracle for.
+*/
+enum fuzz_generator {
+	FUZZ_ADDER, FUZZ_BITADDER, FUZZ_CSA_BITADDER, FUZZ_INT_ADDER, FUZZ_EXINT_ADDER, FUZZ_PREFIX_INT_ADDER,
+	FUZZ_PREFIX_EXINT_ADDER, FUZZ_COMPARE, FUZZ_LESS, FUZZ_TREE_COMPARE, FUZZ_TREE_LESS, FUZZ_SELECTOR,
+	FUZZ_KMIN, FUZZ_KMIN_FAST, FUZZ_BUILD_KMIN, FUZZ_KMIN_HIER, END_OF_FUZZ
+};
+
+const char* fuzz_name(fuzz_generator g);
+
+/*
+* A generator with its parameters; l is only used by the kmin generators (FUZZ_KMIN_FAST is kmin_circuit with the CSA
+* popcount, prefix adder and tree comparator, FUZZ_KMIN_HIER is the flattened kmin_hier).
+*
+* The input is described as fields, each an unsigned integer whose bits are consecutive input wires, MSB first
+* (e.g. for int_adder: a, then b; for kmin_circuit: the n values, then k; for bitadder_circuit: the bits, 64 per field).
+*/
+struct fuzz_target {
+	fuzz_generator generator;
+	int n, l;
+
+	compiled_circuit build() const;
+	std::vector<int> widths() const;
+
+	/*
+	* The expected output, computed in software (e.g. nth_element for kmin).
+	*/
+	std::vector<bool> oracle(const std::vector<uint64_t>& fields) const;
+
+	/*
+	* Whether the fields are a legal input (e.g. 1 <= k <= n).
+	*/
+	bool valid(const std::vector<uint64_t>& fields) const;
+
+	std::string name() const;
+};
+
+/*
+* A failing input, shrunk: no field can be made smaller (set to 0, halved, a bit cleared, decremented)
+* without the failure going away.
+*/
+struct fuzz_failure {
+	fuzz_target target;
+	std::vector<uint64_t> fields;
+	std::vector<bool> expected, got;
+
+	/*
+	* A one-line reproducer: the target, the fields and both outputs.
+	*/
+	std::string describe() const;
+};
+
+struct fuzz_options {
+	uint64_t seed = 1;
+	int batches = 64;       // per target; a batch is 64 * words input vectors
+	int words = 16;
+	int threads = 0;        // 0: one per hardware thread
+	bool adversarial = true;
+};
+
+struct fuzz_report {
+	long long checks = 0;   // input vectors compared
+	double seconds = 0;
+	std::vector<fuzz_failure> failures;
+};
+
+/*
+* Differential testing of circuit against the oracle of target.
+*
+* Batches are generated from the seed alone (batch b of a target always gets the same inputs, whatever the number
+* of threads), evaluated lane-packed by eval_batch, and compared lane by lane against the oracle; the batches are spread
+* over a thread_pool. With adversarial inputs, each vector is drawn in one of several modes: uniform, all values equal,
+* every field 0 or all ones, few distinct values, values near the maximum; for kmin, k is 1 or n a half of the time.
+* The first failure (in batch order) is shrunk and reported.
+*/
+fuzz_report fuzz(const fuzz_target& target, const compiled_circuit& circuit, const fuzz_options& opt = fuzz_options());
+
+/*
+* Every generator over a sweep of sizes, with n around the powers of two (where the split of bitadder_circuit is subtle).
+*/
+std::vector<fuzz_target> fuzz_targets();
+
+fuzz_report fuzz_all(const fuzz_options& opt = fuzz_options());
+
+void test_fuzz();
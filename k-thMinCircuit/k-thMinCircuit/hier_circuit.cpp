@@ -0,0 +1,211 @@
+#include "hier_circuit.h"
+#include "kmin_circuit.h"
+#include "circuit_opt.h"
+#include "circuit_stats.h"
+#include "adder_circuit.h"
+
+#include <set>
+#include <chrono>
+#include <cstring>
+
+hier_circuit::hier_circuit(int fanin)
+	: nin(fanin), nwire(fanin) {}
+
+std::vector<int> hier_circuit::instantiate(const std::shared_ptr<const compiled_circuit>& M, const std::vector<int>& bind) {
+	if (bind.size() != M->fanin()) throw "Wrong number of port bindings.";
+	for (int w : bind) {
+		if (w < 0 || w >= nwire) throw "Port bound to an unknown wire.";
+	}
+	inst.push_back({ M, bind, nwire });
+	std::vector<int> ret;
+	for (int j(0); j != M->fanout(); ++j) ret.push_back(nwire++);
+	return ret;
+}
+
+int hier_circuit::constant(bool v) {
+	if (constants[v] < 0) constants[v] = nwire++;
+	return constants[v];
+}
+
+int hier_circuit::fanin() const {
+	return nin;
+}
+
+int hier_circuit::fanout() const {
+	return out.size();
+}
+
+int hier_circuit::wires() const {
+	return nwire;
+}
+
+const std::vector<hier_circuit::instance>& hier_circuit::instances() const {
+	return inst;
+}
+
+std::vector<bool> hier_circuit::eval(const std::vector<bool>& input) const {
+	if (input.size() != nin) return {}; // invalid input.
+	std::vector<uint64_t> in(nin), ret(out.size());
+	for (int i(0); i != nin; ++i) in[i] = input[i];
+	eval_batch(in.data(), ret.data(), 1);
+	std::vector<bool> output;
+	for (uint64_t w : ret) output.push_back(w & 1);
+	return output;
+}
+
+void hier_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words) const {
+	// the value of every wire; the outputs of an instance are written in place.
+	std::vector<uint64_t> val(size_t(nwire) * words), buf;
+	std::memcpy(val.data(), input, sizeof(uint64_t) * nin * words);
+	for (int v(0); v != 2; ++v) {
+		if (constants[v] >= 0) std::fill(val.begin() + size_t(constants[v]) * words, val.begin() + size_t(constants[v] + 1) * words, v ? ~uint64_t(0) : 0);
+	}
+	for (const instance& I : inst) {
+		buf.resize(I.bind.size() * words);
+		for (int i(0); i != I.bind.size(); ++i) {
+			std::memcpy(buf.data() + size_t(i) * words, val.data() + size_t(I.bind[i]) * words, sizeof(uint64_t) * words);
+		}
+		I.module->eval_batch(buf.data(), val.data() + size_t(I.first_out) * words, words);
+	}
+	for (int j(0); j != out.size(); ++j) {
+		std::memcpy(output + size_t(j) * words, val.data() + size_t(out[j]) * words, sizeof(uint64_t) * words);
+	}
+}
+
+long long hier_circuit::gate_count() const {
+	long long ret(nin);
+	for (const instance& I : inst) ret += I.module->gate_count() - I.module->fanin();
+	return ret;
+}
+
+size_t hier_circuit::bytes() const {
+	size_t ret(sizeof(*this) + out.size() * sizeof(int));
+	std::set<const compiled_circuit*> seen;
+	for (const instance& I : inst) {
+		ret += sizeof(instance) + I.bind.size() * sizeof(int);
+		if (seen.insert(I.module.get()).second) {
+			const compiled_circuit& M(*I.module);
+			ret += M.type.size() + (M.in0.size() + M.in1.size() + M.in2.size() + M.level_begin.size() + M.out.size()) * sizeof(int);
+		}
+	}
+	return ret;
+}
+
+/*
+* A gate of type t reading a, b, c (up to its arity) in C. Two ports of an instance may be bound to the same wire,
+* so the gate may read the same gate twice, which concat does not allow: it is folded into an equivalent gate instead.
+*/
+static gate* _module_gate(circuit& C, gate::gate_type t, gate* a, gate* b, gate* c) {
+	int arity(gate::arity(t));
+	if (arity == 2 && a == b) {
+		// f(x, x) is x, NOT(x) or a constant
+		bool f0(gate::apply(t, false, false, false)), f1(gate::apply(t, true, true, false));
+		if (f0 == f1) return C.constant(f0);
+		if (f1) return a;
+		gate* r(C.new_gate(gate::NOT));
+		r->concat(a);
+		return r;
+	}
+	if (arity == 3 && (a == b || b == c || a == c)) {
+		if (t == gate::MAJ) return b == c ? b : a;
+		if (t != gate::MUX) throw "Unknown gate.";
+		// MUX(s, x, x) = x, MUX(s, s, x) = AND(s, x), MUX(s, x, s) = OR(s, x)
+		if (b == c) return b;
+		gate* r(C.new_gate(a == b ? gate::AND : gate::OR));
+		r->concat(a, a == b ? c : b);
+		return r;
+	}
+	gate* r(C.new_gate(t));
+	if (arity == 3) r->concat(a, b, c);
+	else if (arity == 2) r->concat(a, b);
+	else r->concat(a);
+	return r;
+}
+
+flattened_circuit::flattened_circuit(const hier_circuit& H)
+	: circuit(H.fanin(), H.fanout())
+{
+	std::vector<gate*> wire(H.wires(), nullptr);
+	for (int i(0); i != H.fanin(); ++i) wire[i] = in[i];
+	for (int v(0); v != 2; ++v) {
+		if (H.constants[v] >= 0) wire[H.constants[v]] = constant(v);
+	}
+	for (const hier_circuit::instance& I : H.instances()) {
+		const compiled_circuit& M(*I.module);
+		std::vector<gate*> g(M.gate_count());
+		for (int i(0); i != M.fanin(); ++i) g[i] = wire[I.bind[i]];
+		for (int i(M.fanin()); i != M.gate_count(); ++i) {
+			switch (M.type[i]) {
+			case gate::ZERO:
+				g[i] = constant(false);
+				break;
+			case gate::ONE:
+				g[i] = constant(true);
+				break;
+			default:
+				g[i] = _module_gate(*this, gate::gate_type(M.type[i]), g[M.in0[i]], M.in1[i] >= 0 ? g[M.in1[i]] : nullptr,
+					M.in2[i] >= 0 ? g[M.in2[i]] : nullptr);
+				break;
+			}
+		}
+		for (int j(0); j != M.fanout(); ++j) wire[I.first_out + j] = g[M.out[j]];
+	}
+	for (int j(0); j != H.fanout(); ++j) out[j] = wire[H.out[j]];
+	remove_void();
+}
+
+void test_hier_circuit() {
+	const int n(100), l(128);
+	bool wrong(false);
+
+	auto t0 = std::chrono::steady_clock::now();
+	kmin_circuit C(n, l);
+	compiled_circuit CC(C);
+	auto t1 = std::chrono::steady_clock::now();
+	kmin_hier H(n, l);
+	auto t2 = std::chrono::steady_clock::now();
+	std::cout << "kmin_circuit(" << n << ", " << l << "): built and compiled in " << std::chrono::duration<double>(t1 - t0).count()
+		<< " s, " << CC.gate_count() << " gates, " << circuit_stats(CC).compiled_bytes << " bytes compiled" << std::endl;
+	std::cout << "kmin_hier(" << n << ", " << l << "):    built in " << std::chrono::duration<double>(t2 - t1).count()
+		<< " s, " << H.gate_count() << " gates, " << H.bytes() << " bytes" << std::endl;
+
+	const int words(16);
+	std::vector<uint64_t> input(CC.fanin() * words), ref(CC.fanout() * words), output(CC.fanout() * words);
+	for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	CC.eval_batch(input.data(), ref.data(), words);
+	H.eval_batch(input.data(), output.data(), words);
+	if (output != ref) wrong = true;
+
+	std::vector<bool> vec;
+	for (int i(0); i != CC.fanin(); ++i) vec.push_back(rand() % 2);
+	if (H.eval(vec) != CC.eval(vec)) wrong = true;
+
+	flattened_circuit F(H);
+	F.check();
+	propagate_constants(F);
+	std::cout << "flattened: size " << F.size() << " (kmin_circuit " << C.size() << ")" << std::endl;
+	if (F.eval(vec) != CC.eval(vec)) wrong = true;
+
+	// a copy of a circuit is a circuit of its own
+	circuit D(F);
+	D.check();
+	F.clear();
+	if (D.eval(vec) != CC.eval(vec)) wrong = true;
+
+	// two ports bound to the same wire: a full adder of (x, x, y) gives (y, x), and its MAJ and XOR read x twice
+	{
+		hier_circuit A(2);
+		A.out = A.instantiate(std::make_shared<const compiled_circuit>(adder_circuit()), { 0, 0, 1 });
+		flattened_circuit FA(A);
+		FA.check();
+		for (int x(0); x != 2; ++x) {
+			for (int y(0); y != 2; ++y) {
+				std::vector<bool> expected{ bool(y), bool(x) };
+				if (A.eval({ bool(x), bool(y) }) != expected || FA.eval({ bool(x), bool(y) }) != expected) wrong = true;
+			}
+		}
+	}
+
+	if (wrong) std::cout << "test_hier_circuit: wrong." << std::endl;
+	else std::cout << "test_hier_circuit: passed." << std::endl;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "circuit.h"
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/*
+* A hierarchical netlist: a list of instances of modules, connected by wires.
+*
+* A module is a compiled_circuit, built once and shared by all of its instances (and by other hier_circuits);
+* an instance only stores which wire drives each of its inputs. A circuit made of l copies of the same module
+* thus costs one module plus l port bindings, instead of l times the module.
+*
+* Wires are numbered: [0, fanin) are the inputs; then every instance gets wires for its outputs, consecutively,
+* in the order the instances are added; constant(v) gives a wire of constant value.
+* An instance may only read wires that exist when it is added, so the instances are in topological order.
+*
+* Evaluation runs each instance's module on its inputs, in order; flattened_circuit expands it into gates, on demand.
+*/
+class hier_circuit {
+	friend class flattened_circuit;
+public:
+	explicit hier_circuit(int fanin);
+
+	struct instance {
+		std::shared_ptr<const compiled_circuit> module;
+		std::vector<int> bind;  // bind[i] is the wire driving input i of the module
+		int first_out;          // the outputs of the module are wires [first_out, first_out + module->fanout())
+	};
+
+	/*
+	* Add an instance of M, with its inputs driven by the given wires; returns the wires of its outputs.
+	* Several inputs may be driven by the same wire.
+	*/
+	std::vector<int> instantiate(const std::shared_ptr<const compiled_circuit>& M, const std::vector<int>& bind);
+
+	/*
+	* The wire of constant value v.
+	*/
+	int constant(bool v);
+
+	/*
+	* out[j] is the wire of the j-th output.
+	*/
+	std::vector<int> out;
+
+	int fanin() const;
+	int fanout() const;
+	int wires() const;
+	const std::vector<instance>& instances() const;
+
+	/*
+	* The same as compiled_circuit::eval / eval_batch, on the flattened circuit.
+	*/
+	std::vector<bool> eval(const std::vector<bool>& input) const;
+	void eval_batch(const uint64_t* input, uint64_t* output, int words) const;
+
+	/*
+	* Number of gates of the flattened circuit (including INPUT gates), the same as compiled_circuit::gate_count.
+	*/
+	long long gate_count() const;
+
+	/*
+	* Bytes used by the instances and the (distinct) modules.
+	*/
+	size_t bytes() const;
+
+protected:
+	int nin, nwire;
+	int constants[2] = { -1, -1 };
+	std::vector<instance> inst;
+};
+
+/*
+* A hier_circuit expanded into gates: every instance becomes a copy of its module.
+* If two ports of an instance are bound to the same wire, the gates of the copy that would read it twice are folded.
+*/
+class flattened_circuit :
+    public circuit
+{
+public:
+    explicit flattened_circuit(const hier_circuit& H);
+};
+
+void test_hier_circuit();
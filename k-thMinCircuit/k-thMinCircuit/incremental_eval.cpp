@@ -0,0 +1,157 @@
+#include "incremental_eval.h"
+#include "kmin_circuit.h"
+
+#include <chrono>
+
+incremental_evaluator::incremental_evaluator(const compiled_circuit& C)
+	: C(C), level(C.gate_count()), fanout_begin(C.gate_count() + 1, 0),
+	val(C.gate_count(), 0), queued(C.gate_count(), 0), pending(C.depth() + 1)
+{
+	for (int d(0); d + 1 < C.level_begin.size(); ++d) {
+		for (int g(C.level_begin[d]); g != C.level_begin[d + 1]; ++g) level[g] = d;
+	}
+	for (int g(0); g != C.gate_count(); ++g) {
+		if (C.in0[g] >= 0) ++fanout_begin[C.in0[g] + 1];
+		if (C.in1[g] >= 0) ++fanout_begin[C.in1[g] + 1];
+		if (C.in2[g] >= 0) ++fanout_begin[C.in2[g] + 1];
+	}
+	for (int g(0); g != C.gate_count(); ++g) fanout_begin[g + 1] += fanout_begin[g];
+	fanout.resize(fanout_begin.back());
+	std::vector<int> pos(fanout_begin.begin(), fanout_begin.end() - 1);
+	for (int g(0); g != C.gate_count(); ++g) {
+		if (C.in0[g] >= 0) fanout[pos[C.in0[g]]++] = g;
+		if (C.in1[g] >= 0) fanout[pos[C.in1[g]]++] = g;
+		if (C.in2[g] >= 0) fanout[pos[C.in2[g]]++] = g;
+	}
+}
+
+bool incremental_evaluator::recompute(int g) {
+	gate::gate_type t = gate::gate_type(C.type[g]);
+	if (t == gate::INPUT || t >= gate::END_OF_TYPE) throw "Ill-formed compiled circuit.";
+	int arity(gate::arity(t));
+	char v = gate::apply(t, arity > 0 && val[C.in0[g]], arity > 1 && val[C.in1[g]], arity > 2 && val[C.in2[g]]);
+	++cnt;
+	if (v == val[g]) return false;
+	val[g] = v;
+	return true;
+}
+
+std::vector<bool> incremental_evaluator::eval(const std::vector<bool>& input) {
+	if (input.size() != C.fanin()) return {}; // invalid input.
+	cnt = 0;
+	int g(0);
+	for (; g != C.fanin(); ++g) val[g] = input[g];
+	for (; g != C.gate_count(); ++g) recompute(g);
+	valid = true;
+	return output();
+}
+
+void incremental_evaluator::schedule(int g) {
+	for (int e(fanout_begin[g]); e != fanout_begin[g + 1]; ++e) {
+		int to(fanout[e]);
+		if (!queued[to]) {
+			queued[to] = 1;
+			pending[level[to]].push_back(to);
+			++remaining;
+		}
+	}
+}
+
+void incremental_evaluator::propagate() {
+	// A gate only schedules gates on higher levels, so one pass over the levels is enough.
+	for (int d(1); d != pending.size() && remaining; ++d) {
+		for (int g : pending[d]) {
+			queued[g] = 0;
+			if (recompute(g)) schedule(g);
+		}
+		remaining -= pending[d].size();
+		pending[d].clear();
+	}
+}
+
+std::vector<bool> incremental_evaluator::update(const std::vector<bool>& input) {
+	if (!valid) return eval(input);
+	if (input.size() != C.fanin()) return {}; // invalid input.
+	cnt = 0;
+	for (int g(0); g != C.fanin(); ++g) {
+		if (val[g] != char(input[g])) {
+			val[g] = input[g];
+			schedule(g);
+		}
+	}
+	propagate();
+	return output();
+}
+
+std::vector<bool> incremental_evaluator::flip(const std::vector<int>& inputs) {
+	if (!valid) throw "Nothing evaluated yet.";
+	cnt = 0;
+	for (int g : inputs) {
+		if (g < 0 || g >= C.fanin()) throw "Input index out of range.";
+		val[g] = !val[g];
+		schedule(g);
+	}
+	propagate();
+	return output();
+}
+
+std::vector<bool> incremental_evaluator::output() const {
+	std::vector<bool> ret;
+	for (int g : C.out) ret.push_back(val[g]);
+	return ret;
+}
+
+long long incremental_evaluator::touched() const {
+	return cnt;
+}
+
+void test_incremental_eval() {
+	const int n(100), l(128), rounds(50);
+	int logn(_count_bits(n));
+	kmin_circuit C(n, l);
+	compiled_circuit CC(C);
+	incremental_evaluator E(CC);
+
+	std::vector<bool> input;
+	for (int i(0); i != n * l; ++i) input.push_back(rand() % 2);
+	for (int i(0); i != logn; ++i) input.push_back(false);
+	auto set_k = [&](int ik) {
+		for (int i(0); i != logn; ++i) input[n * l + i] = (ik >> (logn - i - 1)) & 1;
+	};
+	set_k(1);
+	E.eval(input);
+	std::cout << "full eval: " << E.touched() << " of " << CC.gate_count() << " gates" << std::endl;
+
+	bool wrong(false);
+	long long touched[2] = { 0, 0 };
+	double sec[2] = { 0, 0 };
+	for (int _(0); _ != rounds; ++_) {
+		// the first half only changes k; the second half flips a few bits of the values.
+		int kind = (_ < rounds / 2 ? 0 : 1);
+		std::vector<bool> ret;
+		auto t0 = std::chrono::steady_clock::now();
+		if (kind == 0) {
+			set_k(rand() % n + 1);
+			t0 = std::chrono::steady_clock::now();
+			ret = E.update(input);
+		} else {
+			std::vector<int> flipped;
+			for (int t(0); t != 3; ++t) flipped.push_back(rand() % (n * l));
+			for (int g : flipped) input[g] = !input[g];
+			t0 = std::chrono::steady_clock::now();
+			ret = E.flip(flipped);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		touched[kind] += E.touched();
+		sec[kind] += std::chrono::duration<double>(t1 - t0).count();
+		if (ret != CC.eval(input)) wrong = true;
+	}
+	auto t0 = std::chrono::steady_clock::now();
+	for (int _(0); _ != rounds / 2; ++_) CC.eval(input);
+	double full = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / (rounds / 2);
+	std::cout << "k changed:       " << touched[0] / (rounds / 2) << " gates touched, " << sec[0] / (rounds / 2) * 1e6 << " us per update" << std::endl;
+	std::cout << "3 value bits:    " << touched[1] / (rounds / 2) << " gates touched, " << sec[1] / (rounds / 2) * 1e6 << " us per update" << std::endl;
+	std::cout << "full eval:       " << full * 1e6 << " us" << std::endl;
+	if (wrong) std::cout << "test_incremental_eval: wrong." << std::endl;
+	else std::cout << "test_incremental_eval: passed." << std::endl;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "compiled_circuit.h"
+
+#include <vector>
+
+/*
+* Event-driven evaluation of a compiled circuit, for consecutive inputs that differ in only a few bits.
+*
+* It keeps the value of every gate from the previous evaluation. On update, only the fan-out cone of the
+* flipped inputs is visited, level by level, and the propagation stops at every gate whose value does not change.
+* touched() reports how many gates were recomputed, to be compared with compiled_circuit::gate_count().
+*/
+class incremental_evaluator {
+public:
+	/*
+	* C must outlive the evaluator.
+	*/
+	explicit incremental_evaluator(const compiled_circuit& C);
+
+	/*
+	* Evaluate from scratch; every gate is touched.
+	*/
+	std::vector<bool> eval(const std::vector<bool>& input);
+
+	/*
+	* Evaluate incrementally w.r.t. the previous input.
+	* If nothing has been evaluated yet, it is the same as eval.
+	*/
+	std::vector<bool> update(const std::vector<bool>& input);
+
+	/*
+	* Flip the given input wires and evaluate incrementally; this saves comparing the whole input vector.
+	* Something must have been evaluated before.
+	*/
+	std::vector<bool> flip(const std::vector<int>& inputs);
+
+	/*
+	* The output of the last evaluation.
+	*/
+	std::vector<bool> output() const;
+
+	/*
+	* Number of gates (excluding INPUT gates) recomputed by the last eval / update.
+	*/
+	long long touched() const;
+
+private:
+	bool recompute(int g);
+	void schedule(int g);
+	void propagate();
+
+	const compiled_circuit& C;
+	std::vector<int> level;
+	// fan-out in CSR form: the consumers of gate g are fanout[fanout_begin[g], fanout_begin[g + 1]).
+	std::vector<int> fanout_begin, fanout;
+	std::vector<char> val, queued;
+	std::vector<std::vector<int>> pending; // per level
+	bool valid = false;
+	long long cnt = 0;
+	int remaining = 0;
+};
+
+void test_incremental_eval();
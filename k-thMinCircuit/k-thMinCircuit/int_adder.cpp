@@ -4,13 +4,13 @@ int_adder::int_adder(int n)
 	: circuit(2 * n, n)
 {
 	if (n == 1) {
-		gate *gxor = new gate(gate::XOR);
+		gate *gxor = new_gate(gate::XOR);
 		gxor->concat(in[0], in[1]);
 		out[0] = gxor;
 		return;
 	}
 	// First, create a half adder manually
-	gate* gxor = new gate(gate::XOR), * gand = new gate(gate::AND);
+	gate* gxor = new_gate(gate::XOR), * gand = new_gate(gate::AND);
 	gxor->concat(in[n - 1], in[2 * n - 1]);
 	gand->concat(in[n - 1], in[2 * n - 1]);
 	out[n - 1] = gxor;
@@ -25,13 +25,13 @@ int_adder::int_adder(int n)
 		adder.in[2]->concat(carry);
 		out[i] = adder.out[0];
 		carry = adder.out[1];
-		adder.moderate_clear();
+		adopt(adder);
 	}
 	
 
 	// Last, construct 2 xor
 	gate* garr[2];
-	gate::init(garr, 2, gate::XOR);
+	new_gates(garr, 2, gate::XOR);
 	garr[0]->concat(in[i], in[i + n]);
 	garr[1]->concat(garr[0], carry);
 	out[i] = garr[1];
@@ -41,7 +41,7 @@ exint_adder::exint_adder(int n)
 	: circuit(2 * n, n + 1)
 {
 	// First, create a half adder manually
-	gate* gxor = new gate(gate::XOR), * gand = new gate(gate::AND);
+	gate* gxor = new_gate(gate::XOR), * gand = new_gate(gate::AND);
 	gxor->concat(in[n - 1], in[2 * n - 1]);
 	gand->concat(in[n - 1], in[2 * n - 1]);
 	out[n] = gxor;
@@ -60,7 +60,7 @@ exint_adder::exint_adder(int n)
 		adder.in[2]->concat(carry);
 		out[i+1] = adder.out[0];
 		carry = adder.out[1];
-		adder.moderate_clear();
+		adopt(adder);
 	}
 	out[0] = carry;
 }
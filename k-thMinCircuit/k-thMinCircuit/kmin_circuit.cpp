@@ -1,4 +1,6 @@
 #include "kmin_circuit.h"
+#include "circuit_opt.h"
+#include "kmin_reference.h"
 
 /*
 * This is the k-th min algorithm we are going to implement.
@@ -68,79 +70,145 @@ void test_kmin() {
 }
 
 
-kmin_circuit::kmin_circuit(int n, int l)
-	: circuit(n * l + _count_bits(n) + 1, l)
+circuit kmin_circuit::popcount(int n, const kmin_options& opt) {
+	switch (opt.popcount) {
+	case kmin_options::RIPPLE_POPCOUNT:
+		return bitadder_circuit(n);
+	case kmin_options::CSA_POPCOUNT:
+		return csa_bitadder_circuit(n);
+	default:
+		throw "Unknown popcount type.";
+	}
+}
+
+circuit kmin_circuit::sum_adder(int n, const kmin_options& opt) {
+	switch (opt.adder) {
+	case kmin_options::RIPPLE_ADDER:
+		return int_adder(n);
+	case kmin_options::PREFIX_ADDER:
+		return prefix_int_adder(n, opt.topology);
+	default:
+		throw "Unknown adder type.";
+	}
+}
+
+circuit kmin_circuit::less_than(int n, const kmin_options& opt) {
+	switch (opt.comparator) {
+	case kmin_options::LINEAR_COMPARATOR:
+		return less_circuit(n);
+	case kmin_options::TREE_COMPARATOR:
+		return tree_less_circuit(n);
+	default:
+		throw "Unknown comparator type.";
+	}
+}
+
+kmin_stage::kmin_stage(int n, const kmin_options& opt)
+	: circuit(2 * n + 2 * _count_bits(n), 1 + n + _count_bits(n))
+{
+	int logn(_count_bits(n));
+	std::vector<gate*> x(in.begin(), in.begin() + n), dead(in.begin() + n, in.begin() + 2 * n);
+	std::vector<gate*> strict_less(in.begin() + 2 * n, in.begin() + 2 * n + logn), k(in.begin() + 2 * n + logn, in.end());
+	// Unlike the software version, a dead value keeps participating in the circuit, with all its bits read as 1.
+	// zero[j] = NOT(x[j] OR dead[j]) is whether value j is alive with a 0 bit; it is all that is needed of the bit.
+	std::vector<gate*> zero(n);
+	for (int j(0); j != n; ++j) {
+		zero[j] = new_gate(gate::NOR);
+		zero[j]->concat(x[j], dead[j]);
+	}
+
+	circuit adder(kmin_circuit::popcount(n, opt));
+	std::vector<gate*> cnt;
+	for (int j(0); j != n; ++j) adder.in[j]->concat(zero[j]);
+	for (int j(adder.out.size() - 1); j >= 0; --j) {
+		cnt.push_back(adder.out[j]);
+		// Caution : adder is small endian.
+	}
+	adopt(adder);
+
+
+	circuit new_sl(kmin_circuit::sum_adder(logn, opt)); // = strict_less + cnt
+	for (int j(0); j != logn; ++j) new_sl.in[j]->concat(strict_less[j]);
+	for (int j(0); j != logn; ++j) new_sl.in[j + logn]->concat(cnt[j]);
+	std::vector<gate*> sum(std::move(new_sl.out)); // = strict_less + cnt
+	for (int j(0); j != logn; ++j) {
+		sum[j]->name(std::string("-SUM") + char(j + '0'));
+	}
+	adopt(new_sl);
+	assert(sum.size() == logn);
+
+
+	circuit comp(kmin_circuit::less_than(logn, opt));
+	for (int j(0); j != logn; ++j) comp.in[j]->concat(sum[j]);
+	for (int j(0); j != logn; ++j) comp.in[j + logn]->concat(k[j]);
+	gate* lesser = comp.out[0];
+	adopt(comp);
+	out[0] = lesser;
+
+
+	// use leq to select new value for strict_less
+	selector sel(logn);
+	sel.in[logn * 2]->concat(lesser);
+	// if leq == false, remain unchanged
+	for (int j(0); j != logn; ++j) sel.in[j]->concat(strict_less[j]);
+	// if leq == true, select the "added" value
+	for (int j(0); j != logn; ++j) sel.in[j + logn]->concat(sum[j]);
+	for (int j(0); j != logn; ++j) out[1 + n + j] = sel.out[j];
+	adopt(sel);
+
+	// (x[j] OR dead[j]) XOR lesser = zero[j] XNOR lesser
+	for (int j(0); j != n; ++j) {
+		gate* gor(new_gate(gate::OR)), * gxnor(new_gate(gate::XNOR));
+		gxnor->concat(zero[j], lesser);
+		gor->concat(dead[j], gxnor);
+		out[1 + j] = gor;
+	}
+}
+
+kmin_circuit::kmin_circuit(int n, int l, const kmin_options& opt)
+	: circuit(n * l + _count_bits(n), l)
 {
 	int logn(_count_bits(n));
-	gate* zero(in[n * l + logn]);
+	gate* zero(constant(false));
 	std::vector<gate*> k, strict_less; // big endian integer
-	std::vector<gate*> dead, val; // boolean array
+	std::vector<gate*> dead; // boolean array
 	k = { in.begin() + n * l, in.begin() + n * l + logn };
 	strict_less.resize(logn, zero);
 	dead.resize(n, zero);
-	val = {in.begin(), in.begin() + n * l};
-
 
 	for (int i(0); i != l; ++i) {
-		bitadder_circuit adder(n);
-		std::vector<gate*> cnt;
-		for (int j(0); j != n; ++j) {
-			gate* gnot(new gate(gate::NOT));
-			gnot->concat(val[j * l + i]);
-			adder.in[j]->concat(gnot);
-		}
-		for (int j(adder.out.size() - 1); j >= 0; --j) {
-			cnt.push_back(adder.out[j]);
-			// Caution : adder is small endian.
-		}
-		adder.moderate_clear();
-
+		kmin_stage S(n, opt);
+		for (int j(0); j != n; ++j) S.in[j]->concat(in[j * l + i]);
+		for (int j(0); j != n; ++j) S.in[n + j]->concat(dead[j]);
+		for (int j(0); j != logn; ++j) S.in[2 * n + j]->concat(strict_less[j]);
+		for (int j(0); j != logn; ++j) S.in[2 * n + logn + j]->concat(k[j]);
+		out[i] = S.out[0];
+		out[i]->name(std::string("-lesser") + char(i + '0'));
+		dead = { S.out.begin() + 1, S.out.begin() + 1 + n };
+		strict_less = { S.out.begin() + 1 + n, S.out.end() };
+		adopt(S);
+	}
+	// The constant 0 of the first stage is folded, and the dead values of the last stage are removed.
+	propagate_constants(*this);
+}
 
-		int_adder new_sl(logn); // = strict_less + cnt
-		for (int j(0); j != logn; ++j) new_sl.in[j]->concat(strict_less[j]);
-		for (int j(0); j != logn; ++j) new_sl.in[j + logn]->concat(cnt[j]);
-		std::vector<gate*> sum(std::move(new_sl.out)); // = strict_less + cnt
-		for (int j(0); j != logn; ++j) {
-			sum[j]->name(std::string("-SUM") + char(i + '0') + char(j + '0'));
-		}
-		new_sl.moderate_clear();
-		assert(sum.size() == logn);
-
-
-		less_circuit comp(logn);
-		for (int j(0); j != logn; ++j) comp.in[j]->concat(sum[j]);
-		for (int j(0); j != logn; ++j) comp.in[j + logn]->concat(k[j]);
-		gate* lesser = comp.out[0];
-		comp.moderate_clear();
-
-
-		out[i] = lesser;
-		out[i]->name(std::string("-lesser") + char(i+'0'));
-
-
-		// use leq to select new value for strict_less
-		selector sel(logn);
-		sel.in[logn * 2]->concat(lesser);
-		// if leq == false, remain unchanged
-		for (int j(0); j != logn; ++j) sel.in[j]->concat(strict_less[j]);
-		// if leq == true, select the "added" value
-		for (int j(0); j != logn; ++j) sel.in[j + logn]->concat(sum[j]);
-		strict_less = std::move(sel.out);
-		sel.moderate_clear();
-
-		if (i != l - 1) {
-			for (int j(0); j != n; ++j) {
-				gate* gor(new gate(gate::OR)), * gxor(new gate(gate::XOR));
-				gxor->concat(val[j * l + i], out[i]);
-				gor->concat(dead[j], gxor);
-				dead[j] = gor;
-				gate* gor2(new gate(gate::OR));
-				gor2->concat(val[j * l + i + 1], dead[j]);
-				val[j * l + i + 1] = gor2;
-			}
-		}
+kmin_hier::kmin_hier(int n, int l, const kmin_options& opt)
+	: hier_circuit(n * l + _count_bits(n))
+{
+	int logn(_count_bits(n));
+	auto S = std::make_shared<const compiled_circuit>(kmin_stage(n, opt));
+	std::vector<int> dead(n, constant(false)), strict_less(logn, constant(false));
+	for (int i(0); i != l; ++i) {
+		std::vector<int> bind;
+		for (int j(0); j != n; ++j) bind.push_back(j * l + i);
+		bind.insert(bind.end(), dead.begin(), dead.end());
+		bind.insert(bind.end(), strict_less.begin(), strict_less.end());
+		for (int j(0); j != logn; ++j) bind.push_back(n * l + j);
+		std::vector<int> ret(instantiate(S, bind));
+		out.push_back(ret[0]);
+		dead = { ret.begin() + 1, ret.begin() + 1 + n };
+		strict_less = { ret.begin() + 1 + n, ret.end() };
 	}
-	remove_void();
 }
 
 void test_kmin_circuit() {
@@ -152,6 +220,7 @@ void test_kmin_circuit() {
 	std::cout << C.size();
 	std::vector<bool> val[n];
 	std::vector<bool> k;
+	bitsliced_kmin B(n, l); // the reference; kmin itself would take most of the time
 	bool wrong(false);
 	for (int i(0); i != n; ++i) {
 		val[i].resize(l, false);
@@ -175,9 +244,9 @@ void test_kmin_circuit() {
 			k[i] = ((ik >> (logn - i - 1)) & 1);
 			input.push_back(k[i]);
 		}
-		input.push_back(false);
 		auto ret = C.eval(input);
-		auto ans = kmin(val, n, ik);
+		B.load(val);
+		auto ans = B.kmin(ik);
 		for (int i(0); i != l; ++i) {
 			if (ret[i] != ans[i]) {
 				wrong = true;
@@ -5,6 +5,8 @@
 #include "adder_circuit.h"
 #include "int_adder.h"
 #include "selector.h"
+#include "prefix_adder.h"
+#include "hier_circuit.h"
 
 #include <cassert>
 #include <vector>
@@ -16,16 +18,90 @@ void test_kmin();
 
 void test_kmin_circuit();
 
+/*
+* Choices of the sub-circuits used by kmin_circuit. The defaults give the original construction.
+*/
+struct kmin_options {
+	/*
+	* The circuit counting the live zero bits of a column:
+	*     RIPPLE_POPCOUNT: bitadder_circuit
+	*     CSA_POPCOUNT: csa_bitadder_circuit, about 40% smaller, at most one level deeper
+	*/
+	enum popcount_type { RIPPLE_POPCOUNT, CSA_POPCOUNT };
+	popcount_type popcount = RIPPLE_POPCOUNT;
+
+	/*
+	* The adder of the running count strict_less + cnt:
+	*     RIPPLE_ADDER: int_adder
+	*     PREFIX_ADDER: prefix_int_adder with the given topology
+	*/
+	enum adder_type { RIPPLE_ADDER, PREFIX_ADDER };
+	adder_type adder = RIPPLE_ADDER;
+	prefix_topology topology = KOGGE_STONE;
+
+	/*
+	* The comparator strict_less + cnt < k:
+	*     LINEAR_COMPARATOR: less_circuit
+	*     TREE_COMPARATOR: tree_less_circuit
+	*/
+	enum comparator_type { LINEAR_COMPARATOR, TREE_COMPARATOR };
+	comparator_type comparator = LINEAR_COMPARATOR;
+};
+
 /*
 * We now meet the climax: the k-th min circuit, the finale of this project.
 * The method to compute k-th min is illustrated in kmin function.
 * 
 * n is the number of values, l is the length of each value.
-* the input is: n many l-bit inputs + log(n)-bit k + log(n)-bit 0.
+* the input is: n many l-bit inputs + log(n)-bit k.
+* The running count starts from a constant 0, which is folded away (see propagate_constants).
 */
 class kmin_circuit
 	: public circuit
+{
+	friend class kmin_stage;
+public:
+	kmin_circuit(int n, int l, const kmin_options& opt = kmin_options());
+
+protected:
+	/*
+	* The popcount circuit of n bits selected by opt, small endian.
+	*/
+	static circuit popcount(int n, const kmin_options& opt);
+
+	/*
+	* The n-bit adder selected by opt, big endian.
+	*/
+	static circuit sum_adder(int n, const kmin_options& opt);
+
+	/*
+	* The n-bit "strictly less" comparator selected by opt.
+	*/
+	static circuit less_than(int n, const kmin_options& opt);
+};
+
+/*
+* One step of kmin_circuit: it decides one bit of the answer, from the bits x of the same position of all n values.
+* All l steps are the same circuit, so this can also be built once and instantiated l times (see kmin_hier).
+*
+* The input is: x (n bits), dead (n bits), strict_less (log(n) bits), k (log(n) bits).
+* The output is: the answer bit, the new dead (n bits), the new strict_less (log(n) bits).
+* Integers are big endian.
+*/
+class kmin_stage
+	: public circuit
+{
+public:
+	kmin_stage(int n, const kmin_options& opt = kmin_options());
+};
+
+/*
+* The same function as kmin_circuit, as a hier_circuit: a single kmin_stage module, instantiated l times.
+* The first stage reads constant wires for dead and strict_less (kmin_circuit folds them away).
+*/
+class kmin_hier
+	: public hier_circuit
 {
 public:
-	kmin_circuit(int n, int l);
+	kmin_hier(int n, int l, const kmin_options& opt = kmin_options());
 };
@@ -0,0 +1,255 @@
+#include "kmin_pipeline.h"
+#include "parallel_eval.h"
+#include "kmin_reference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+kmin_pipeline::kmin_pipeline(int n, int l, const kmin_options& opt, int threads, int words, int slots)
+	: n(n), l(l), logn(_count_bits(n)), nwords(words), level(detect_simd())
+{
+	if (n < 1 || l < 1 || words < 1 || slots < 0) throw "Invalid pipeline parameters.";
+	S = compiled_circuit(kmin_stage(n, opt));
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min(threads, l);
+	if (slots == 0) slots = 2 * threads;
+	for (int t(0); t <= threads; ++t) group_begin.push_back(int(1LL * l * t / threads));
+
+	ring.resize(slots);
+	for (int b(0); b != slots; ++b) {
+		ring[b].in.resize(size_t(n) * l * words);
+		ring[b].state.resize(size_t(S.fanin()) * words);
+		ring[b].out.resize(size_t(l) * words);
+		free_slots.push_back(slots - 1 - b);
+	}
+	for (int t(0); t <= threads; ++t) queues.emplace_back(new spsc_queue<int>(slots + 1));
+	for (int t(0); t != threads; ++t) workers.emplace_back(&kmin_pipeline::work, this, t);
+}
+
+kmin_pipeline::~kmin_pipeline() {
+	// The batches still in flight are dropped: the stop mark follows them through the pipeline.
+	queues[0]->push_wait(-1);
+	for (auto& t : workers) t.join();
+}
+
+void kmin_pipeline::work(int t) {
+	const size_t W(nwords);
+	std::vector<uint64_t> out(S.fanout() * W), scratch;
+	spsc_queue<int>& from(*queues[t]), & to(*queues[t + 1]);
+	while (true) {
+		int b(from.pop_wait());
+		if (b < 0) {
+			if (t + 1 != threads()) to.push_wait(-1);
+			return;
+		}
+		batch& B(ring[b]);
+		for (int i(group_begin[t]); i != group_begin[t + 1]; ++i) {
+			// x: bit i of every value; dead and strict_less are already there, left by stage i - 1.
+			for (int j(0); j != n; ++j) std::copy_n(&B.in[(size_t(j) * l + i) * W], W, &B.state[j * W]);
+			simd_eval(S, B.state.data(), out.data(), W, 0, W, level, scratch);
+			std::copy_n(&out[0], W, &B.out[i * W]);
+			std::copy_n(&out[W], (n + logn) * W, &B.state[n * W]);
+		}
+		to.push_wait(b);
+	}
+}
+
+bool kmin_pipeline::push(const uint64_t* input) {
+	if (free_slots.empty()) return false;
+	int b(free_slots.back());
+	free_slots.pop_back();
+	batch& B(ring[b]);
+	const size_t W(nwords), nl(size_t(n) * l);
+	std::copy_n(input, nl * W, B.in.begin());
+	// The first stage starts with no dead value and a running count of 0, as in kmin_circuit.
+	std::fill(B.state.begin() + n * W, B.state.begin() + (2 * n + logn) * W, 0);
+	std::copy_n(input + nl * W, logn * W, B.state.begin() + (2 * n + logn) * W);
+	++in_flight;
+	queues[0]->push_wait(b);
+	return true;
+}
+
+bool kmin_pipeline::pop(uint64_t* output) {
+	if (in_flight == 0) return false;
+	int b(queues.back()->pop_wait());
+	std::copy(ring[b].out.begin(), ring[b].out.end(), output);
+	free_slots.push_back(b);
+	--in_flight;
+	return true;
+}
+
+void kmin_pipeline::eval_batch(const uint64_t* input, uint64_t* output, int words) {
+	if (in_flight) throw "Batches are in flight.";
+	const int W(nwords), fin(fanin()), chunks((words + W - 1) / W);
+	std::vector<uint64_t> buf(size_t(fin) * W, 0), res(size_t(l) * W);
+	int popped(0);
+	auto take = [&] {
+		pop(res.data());
+		int w0(popped++ * W), m(std::min(W, words - w0));
+		for (int i(0); i != l; ++i) std::copy_n(&res[size_t(i) * W], m, output + size_t(i) * words + w0);
+	};
+	for (int c(0); c != chunks; ++c) {
+		int w0(c * W), m(std::min(W, words - w0));
+		for (int i(0); i != fin; ++i) {
+			std::copy_n(input + size_t(i) * words + w0, m, &buf[size_t(i) * W]);
+			std::fill(&buf[size_t(i) * W] + m, &buf[size_t(i) * W] + W, 0);
+		}
+		while (!push(buf.data())) take();
+	}
+	while (popped != chunks) take();
+}
+
+std::vector<uint64_t> kmin_pipeline::eval_batch(const std::vector<uint64_t>& input) {
+	if (input.empty() || input.size() % fanin()) return {}; // invalid input.
+	int words = input.size() / fanin();
+	std::vector<uint64_t> ret(size_t(l) * words);
+	eval_batch(input.data(), ret.data(), words);
+	return ret;
+}
+
+int kmin_pipeline::fanin() const {
+	return n * l + logn;
+}
+
+int kmin_pipeline::fanout() const {
+	return l;
+}
+
+int kmin_pipeline::threads() const {
+	return workers.size();
+}
+
+int kmin_pipeline::words() const {
+	return nwords;
+}
+
+int kmin_pipeline::slots() const {
+	return ring.size();
+}
+
+/*
+* A random lane-packed batch of kmin_circuit(n, l), with k in [1, n] in every lane.
+*/
+static std::vector<uint64_t> _random_batch(int n, int l, int words) {
+	int logn(_count_bits(n));
+	std::vector<uint64_t> input(size_t(n * l + logn) * words, 0);
+	for (size_t i(0); i != size_t(n) * l * words; ++i) {
+		input[i] = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	}
+	for (int lane(0); lane != words * 64; ++lane) {
+		int k(rand() % n + 1);
+		for (int i(0); i != logn; ++i) {
+			if ((k >> (logn - i - 1)) & 1) input[(size_t(n) * l + i) * words + lane / 64] |= uint64_t(1) << (lane % 64);
+		}
+	}
+	return input;
+}
+
+void test_kmin_pipeline() {
+	bool wrong(false);
+	// against kmin_circuit, with more batches than slots and a padded last batch
+	kmin_options csa;
+	csa.popcount = kmin_options::CSA_POPCOUNT;
+	csa.adder = kmin_options::PREFIX_ADDER;
+	csa.comparator = kmin_options::TREE_COMPARATOR;
+	struct { int n, l; kmin_options opt; } cases[] = { { 16, 16, {} }, { 100, 32, {} }, { 13, 9, csa }, { 7, 3, {} } };
+	for (auto& c : cases) {
+		compiled_circuit C(kmin_circuit(c.n, c.l, c.opt));
+		std::vector<uint64_t> input(_random_batch(c.n, c.l, 37));
+		auto expected = C.eval_batch(input);
+		for (int threads(1); threads <= 4; ++threads) {
+			for (int words : { 1, 8 }) {
+				kmin_pipeline P(c.n, c.l, c.opt, threads, words);
+				if (P.eval_batch(input) != expected) {
+					std::cout << "kmin_pipeline(" << c.n << ", " << c.l << "), " << threads << " thread(s), "
+						<< words << " word(s): wrong." << std::endl;
+					wrong = true;
+				}
+			}
+		}
+	}
+	// push and pop by hand, against the software kmin
+	{
+		const int n(20), l(24), words(2);
+		kmin_pipeline P(n, l, kmin_options(), 3, words, 4);
+		std::vector<std::vector<uint64_t>> inputs;
+		for (int b(0); b != 10; ++b) inputs.push_back(_random_batch(n, l, words));
+		std::vector<uint64_t> output(size_t(l) * words);
+		int pushed(0), popped(0);
+		while (popped != int(inputs.size())) {
+			if (pushed != int(inputs.size()) && P.push(inputs[pushed].data())) {
+				++pushed;
+				continue;
+			}
+			if (!P.pop(output.data())) {
+				wrong = true;
+				break;
+			}
+			bitsliced_kmin B(n, l);
+			for (int lane(0); lane != words * 64; ++lane) {
+				B.load_lane(inputs[popped].data(), words, lane);
+				int k(0);
+				for (int i(0); i != _count_bits(n); ++i) {
+					k = 2 * k + ((inputs[popped][(size_t(n) * l + i) * words + lane / 64] >> (lane % 64)) & 1);
+				}
+				auto ans = B.kmin(k);
+				for (int j(0); j != l; ++j) {
+					if (((output[j * words + lane / 64] >> (lane % 64)) & 1) != ans[j]) wrong = true;
+				}
+			}
+			++popped;
+		}
+		if (P.pop(output.data())) wrong = true;
+	}
+	// an idle pipeline sleeps: its threads should take (almost) no CPU time
+	{
+		kmin_pipeline P(16, 16, kmin_options(), 4, 1);
+		P.eval_batch(_random_batch(16, 16, 3));
+		std::this_thread::sleep_for(std::chrono::milliseconds(50)); // past the spinning
+		std::clock_t c0(std::clock());
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		double cpu(double(std::clock() - c0) / CLOCKS_PER_SEC);
+		if (cpu > 0.03) {
+			std::cout << "idle kmin_pipeline: " << cpu << " s of CPU time in 0.3 s." << std::endl;
+			wrong = true;
+		}
+	}
+
+	// Throughput on a stream of small batches (8 words, 512 queries each), each evaluated as it comes.
+	const int n(100), l(128), words(8), batches(256);
+	compiled_circuit C(kmin_circuit(n, l));
+	std::vector<uint64_t> input(_random_batch(n, l, words * batches)), expected(C.eval_batch(input));
+	std::vector<uint64_t> batch(size_t(C.fanin()) * words), output(size_t(l) * words);
+	auto rate = [&](double s) { return words * 64 * batches / s; };
+	std::cout << "kmin_circuit(" << n << ", " << l << "), " << batches << " batches of " << words * 64 << " queries, "
+		<< std::max(1u, std::thread::hardware_concurrency()) << " hardware thread(s):" << std::endl;
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		for (int b(0); b != batches; ++b) {
+			for (int i(0); i != C.fanin(); ++i) std::copy_n(&input[size_t(i) * words * batches + b * words], words, &batch[size_t(i) * words]);
+			C.eval_batch(batch.data(), output.data(), words);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		std::cout << "compiled_circuit: " << rate(std::chrono::duration<double>(t1 - t0).count()) << " queries/s" << std::endl;
+	}
+	int hw = std::max(1u, std::thread::hardware_concurrency());
+	for (int threads(1); threads <= hw; threads *= 2) {
+		parallel_evaluator E(C, threads);
+		auto t0 = std::chrono::steady_clock::now();
+		for (int b(0); b != batches; ++b) {
+			for (int i(0); i != C.fanin(); ++i) std::copy_n(&input[size_t(i) * words * batches + b * words], words, &batch[size_t(i) * words]);
+			E.eval_batch(batch.data(), output.data(), words);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		kmin_pipeline P(n, l, kmin_options(), threads, words);
+		auto t2 = std::chrono::steady_clock::now();
+		auto got = P.eval_batch(input);
+		auto t3 = std::chrono::steady_clock::now();
+		if (got != expected) wrong = true;
+		std::cout << threads << " thread(s): parallel_evaluator " << rate(std::chrono::duration<double>(t1 - t0).count())
+			<< " queries/s, kmin_pipeline " << rate(std::chrono::duration<double>(t3 - t2).count()) << " queries/s" << std::endl;
+	}
+	if (wrong) std::cout << "test_kmin_pipeline: wrong." << std::endl;
+	else std::cout << "test_kmin_pipeline: passed." << std::endl;
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include "kmin_circuit.h"
+#include "compiled_circuit.h"
+#include "simd_kernel.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+/*
+* A bounded lock-free queue between one producer thread and one consumer thread.
+* push and pop never block: push returns false if the queue is full, pop if it is empty.
+* push_wait and pop_wait block instead: they spin for a while, then sleep until the other side makes progress,
+* so an idle thread does not keep its core busy. Only a side that actually sleeps costs the other one a lock.
+* An element pushed is visible to pop along with everything the producer wrote before pushing it.
+*/
+template <class T>
+class spsc_queue {
+public:
+	explicit spsc_queue(int capacity)
+		: ring(capacity + 1)
+	{}
+
+	bool push(const T& x) {
+		if (!try_push(x)) return false;
+		wake_up();
+		return true;
+	}
+
+	bool pop(T& x) {
+		if (!try_pop(x)) return false;
+		wake_up();
+		return true;
+	}
+
+	void push_wait(const T& x) {
+		if (!spin([&] { return try_push(x); })) {
+			std::unique_lock<std::mutex> lock(mtx);
+			sleepers.fetch_add(1);
+			cv.wait(lock, [&] { return try_push(x); });
+			sleepers.fetch_sub(1);
+		}
+		wake_up();
+	}
+
+	T pop_wait() {
+		T x;
+		if (!spin([&] { return try_pop(x); })) {
+			std::unique_lock<std::mutex> lock(mtx);
+			sleepers.fetch_add(1);
+			cv.wait(lock, [&] { return try_pop(x); });
+			sleepers.fetch_sub(1);
+		}
+		wake_up();
+		return x;
+	}
+
+private:
+	bool try_push(const T& x) {
+		size_t t(tail.load(std::memory_order_relaxed)), next((t + 1) % ring.size());
+		if (next == head.load(std::memory_order_acquire)) return false;
+		ring[t] = x;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T& x) {
+		size_t h(head.load(std::memory_order_relaxed));
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		x = ring[h];
+		head.store((h + 1) % ring.size(), std::memory_order_release);
+		return true;
+	}
+
+	/*
+	* Try f a bounded number of times, busy at first, then yielding the CPU.
+	*/
+	template <class F>
+	static bool spin(F f) {
+		for (int i(0); i != 256; ++i) {
+			if (f()) return true;
+			if (i >= 64) std::this_thread::yield();
+		}
+		return false;
+	}
+
+	/*
+	* Wake the other side if it sleeps. The fence orders the update of head / tail before the read of sleepers,
+	* as the increment of sleepers is ordered before the last check of a sleeper: one of the two sees the other.
+	*/
+	void wake_up() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) == 0) return;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+		}
+		cv.notify_all();
+	}
+
+	std::vector<T> ring;
+	// on different cache lines, as they are written by different threads
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	alignas(64) std::atomic<int> sleepers{ 0 };
+	std::mutex mtx;
+	std::condition_variable cv;
+};
+
+/*
+* Streaming evaluation of kmin_circuit, pipelined by stages over threads.
+*
+* kmin_circuit is a chain of l kmin_stage's: stage i reads bit i of the values, k, and the state (dead, strict_less)
+* left by stage i - 1. The pipeline compiles one kmin_stage, and splits the l stages into threads() groups of
+* consecutive stages, each run by its own thread. A batch of queries goes through the groups in order: once a thread
+* has run its stages on a batch, it hands the batch (with its state) to the next thread through an spsc_queue and
+* takes the next batch. So up to threads() batches are evaluated at once, one per group, even if each is small.
+*
+* A batch is words() lane-packed words (64 queries each), laid out as for compiled_circuit::eval_batch of
+* kmin_circuit(n, l): fanin() rows of words() words in, fanout() = l rows out.
+*
+* A thread waiting for a batch spins briefly, then sleeps (see spsc_queue::pop_wait), so an idle pipeline takes no
+* CPU time. As the waits start by spinning, threads() should not exceed the number of cores.
+*/
+class kmin_pipeline {
+public:
+	/*
+	* threads = 0 means one per hardware thread; there are at most l threads. slots is the number of batches that can
+	* be in flight at once, 0 meaning two per thread. It throws if a parameter is out of range.
+	*/
+	kmin_pipeline(int n, int l, const kmin_options& opt = kmin_options(), int threads = 0, int words = 8, int slots = 0);
+	~kmin_pipeline();
+
+	kmin_pipeline(const kmin_pipeline&) = delete;
+	kmin_pipeline& operator=(const kmin_pipeline&) = delete;
+
+	/*
+	* Submit a batch. It returns false, and submits nothing, if slots() batches are already in flight: pop one first.
+	*/
+	bool push(const uint64_t* input);
+
+	/*
+	* Wait for the oldest batch in flight and write its outputs. Batches come out in the order they were pushed.
+	* It returns false if no batch is in flight.
+	*/
+	bool pop(uint64_t* output);
+
+	/*
+	* Same as compiled_circuit::eval_batch of kmin_circuit(n, l), for any number of words: the batch is cut into
+	* batches of words() words (the last one padded), streamed through the pipeline.
+	* No batch may be in flight.
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words);
+	std::vector<uint64_t> eval_batch(const std::vector<uint64_t>& input);
+
+	int fanin() const;
+	int fanout() const;
+	int threads() const;
+	int words() const;
+	int slots() const;
+
+	/*
+	* Thread t runs the stages [group_begin[t], group_begin[t + 1]).
+	*/
+	std::vector<int> group_begin;
+
+private:
+	struct batch {
+		std::vector<uint64_t> in;     // the input, as pushed
+		std::vector<uint64_t> state;  // the input of the next stage: x, dead, strict_less, k (rows of kmin_stage)
+		std::vector<uint64_t> out;    // the answer bits decided so far
+	};
+
+	void work(int t);
+
+	int n, l, logn, nwords;
+	compiled_circuit S;
+	simd_level level;
+	std::vector<batch> ring;
+	std::vector<int> free_slots;
+	int in_flight = 0;
+	// queue t feeds thread t; the last one gives the batches back to the caller. -1 stops the threads.
+	std::vector<std::unique_ptr<spsc_queue<int>>> queues;
+	std::vector<std::thread> workers;
+};
+
+void test_kmin_pipeline();
@@ -0,0 +1,227 @@
+#include "kmin_reference.h"
+#include "kmin_circuit.h"
+#include "simd_kernel.h"
+
+#include <algorithm>
+#include <chrono>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+bitsliced_kmin::bitsliced_kmin(int n, int l)
+	: n(n), l(l), words((n + 63) / 64), col(size_t(l) * words, 0)
+{
+	if (n < 1 || l < 1) throw "Invalid size.";
+}
+
+void bitsliced_kmin::set(int i, int j, bool v) {
+	uint64_t& w(col[size_t(j) * words + i / 64]);
+	uint64_t bit(uint64_t(1) << (i % 64));
+	w = v ? (w | bit) : (w & ~bit);
+}
+
+void bitsliced_kmin::set_value(int i, uint64_t v) {
+	if (l > 64) throw "Value longer than 64 bits.";
+	for (int j(0); j != l; ++j) set(i, j, (v >> (l - j - 1)) & 1);
+}
+
+void bitsliced_kmin::load(const std::vector<bool> x[]) {
+	for (int i(0); i != n; ++i) {
+		if (x[i].size() != l) throw "Input of different length";
+	}
+	std::fill(col.begin(), col.end(), 0);
+	for (int j(0); j != l; ++j) {
+		uint64_t* c(&col[size_t(j) * words]);
+		for (int i(0); i != n; ++i) {
+			if (x[i][j]) c[i / 64] |= uint64_t(1) << (i % 64);
+		}
+	}
+}
+
+void bitsliced_kmin::load_lane(const uint64_t* input, int words, int lane) {
+	int w(lane / 64), b(lane % 64);
+	std::fill(col.begin(), col.end(), 0);
+	for (int i(0); i != n; ++i) {
+		for (int j(0); j != l; ++j) {
+			col[size_t(j) * this->words + i / 64] |= ((input[(size_t(i) * l + j) * words + w] >> b) & 1) << (i % 64);
+		}
+	}
+}
+
+/*
+* The number of live zero bits of a column, ~(c | d) over the words; the popcount instruction is only used
+* where the CPU has it (every CPU with AVX2 does), see _live_zeros.
+*/
+static int _live_zeros_generic(const uint64_t* c, const uint64_t* d, int words) {
+	int ret(0);
+	for (int w(0); w != words; ++w) {
+		uint64_t v(~(c[w] | d[w]));
+#if defined(__GNUC__)
+		ret += __builtin_popcountll(v);
+#else
+		for (; v; v &= v - 1) ++ret;
+#endif
+	}
+	return ret;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("popcnt")))
+static int _live_zeros_popcnt(const uint64_t* c, const uint64_t* d, int words) {
+	int ret(0);
+	for (int w(0); w != words; ++w) ret += __builtin_popcountll(~(c[w] | d[w]));
+	return ret;
+}
+#elif defined(_MSC_VER) && defined(_M_X64)
+static int _live_zeros_popcnt(const uint64_t* c, const uint64_t* d, int words) {
+	int ret(0);
+	for (int w(0); w != words; ++w) ret += int(__popcnt64(~(c[w] | d[w])));
+	return ret;
+}
+#else
+#define KMC_NO_POPCNT
+#endif
+
+static int _live_zeros(const uint64_t* c, const uint64_t* d, int words) {
+#ifndef KMC_NO_POPCNT
+	static const bool popcnt = detect_simd() >= SIMD_AVX2;
+	if (popcnt) return _live_zeros_popcnt(c, d, words);
+#endif
+	return _live_zeros_generic(c, d, words);
+}
+
+std::vector<bool> bitsliced_kmin::kmin(int k) const {
+	if (k < 1 || k > n) throw "k out of range.";
+	std::vector<bool> ret;
+	std::vector<uint64_t> dead(words, 0); // local, so that concurrent queries on one oracle do not share it
+	if (n % 64) dead.back() = ~uint64_t(0) << (n % 64); // the padding is never alive
+	int strict_less(0);
+	for (int i(0); i != l; ++i) {
+		const uint64_t* c(&col[size_t(i) * words]);
+		int cnt = _live_zeros(c, dead.data(), words);
+		bool bit(cnt + strict_less < k);
+		if (bit) strict_less += cnt;
+		ret.push_back(bit);
+		// the values whose bit differs from the answer die
+		uint64_t flip(bit ? ~uint64_t(0) : 0);
+		for (int w(0); w != words; ++w) dead[w] |= c[w] ^ flip;
+	}
+	return ret;
+}
+
+uint64_t bitsliced_kmin::kmin_value(int k) const {
+	if (l > 64) throw "Value longer than 64 bits.";
+	auto bits = kmin(k);
+	uint64_t ret(0);
+	for (int i(0); i != l; ++i) ret = ret << 1 | bits[i];
+	return ret;
+}
+
+int bitsliced_kmin::size() const {
+	return n;
+}
+
+int bitsliced_kmin::length() const {
+	return l;
+}
+
+uint64_t kmin_nth_element(const uint64_t* values, int n, int k) {
+	if (k < 1 || k > n) throw "k out of range.";
+	std::vector<uint64_t> v(values, values + n);
+	std::nth_element(v.begin(), v.begin() + (k - 1), v.end());
+	return v[k - 1];
+}
+
+uint64_t kmin_radix(const uint64_t* values, int n, int l, int k) {
+	if (k < 1 || k > n) throw "k out of range.";
+	if (l < 1 || l > 64) throw "Value longer than 64 bits.";
+	std::vector<uint64_t> cand;
+	const uint64_t* cur(values);
+	int m(n), shift(l);
+	while (shift > 0 && m > 1) {
+		int d(std::min(8, shift));
+		shift -= d;
+		uint64_t mask((uint64_t(1) << d) - 1);
+		int cnt[256] = {};
+		for (int i(0); i != m; ++i) ++cnt[(cur[i] >> shift) & mask];
+		int b(0);
+		for (; k > cnt[b]; ++b) k -= cnt[b];
+		// keep the candidates in bucket b; after the first pass this is in place
+		if (cand.empty()) cand.reserve(cnt[b]);
+		int kept(0);
+		for (int i(0); i != m; ++i) {
+			if (((cur[i] >> shift) & mask) != b) continue;
+			if (cur == values) cand.push_back(cur[i]);
+			else cand[kept] = cur[i];
+			++kept;
+		}
+		cand.resize(kept);
+		cur = cand.data(), m = kept;
+	}
+	return cur[0];
+}
+
+void test_kmin_reference() {
+	bool wrong(false);
+	// against kmin and sorting, including duplicates and n not a multiple of 64
+	for (int _(0); _ != 200; ++_) {
+		int n(rand() % 300 + 1), l(rand() % 64 + 1), k(rand() % n + 1);
+		uint64_t range(l == 64 ? ~uint64_t(0) : (uint64_t(1) << l) - 1);
+		if (_ % 2) range = std::min<uint64_t>(range, 7);
+		std::vector<uint64_t> x(n);
+		std::vector<std::vector<bool>> bx(n);
+		bitsliced_kmin B(n, l);
+		for (int i(0); i != n; ++i) {
+			x[i] = ((uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand()) & range;
+			B.set_value(i, x[i]);
+			for (int j(l - 1); j >= 0; --j) bx[i].push_back((x[i] >> j) & 1);
+		}
+		std::vector<uint64_t> sorted(x);
+		std::sort(sorted.begin(), sorted.end());
+		uint64_t expected(sorted[k - 1]);
+		if (B.kmin_value(k) != expected || kmin_nth_element(x.data(), n, k) != expected
+			|| kmin_radix(x.data(), n, l, k) != expected) wrong = true;
+		if (B.kmin(k) != ::kmin(bx.data(), n, k)) wrong = true;
+	}
+
+	const int l(32), queries(20);
+	for (int n : { 1000, 100000 }) {
+		std::vector<uint64_t> x(n);
+		std::vector<std::vector<bool>> bx(n);
+		for (int i(0); i != n; ++i) {
+			x[i] = (uint64_t(rand()) << 31 ^ rand()) & 0xffffffffu;
+			for (int j(l - 1); j >= 0; --j) bx[i].push_back((x[i] >> j) & 1);
+		}
+		std::vector<int> ks;
+		for (int q(0); q != queries; ++q) ks.push_back(rand() % n + 1);
+		auto t0 = std::chrono::steady_clock::now();
+		bitsliced_kmin B(n, l);
+		for (int i(0); i != n; ++i) B.set_value(i, x[i]);
+		auto t1 = std::chrono::steady_clock::now();
+		double sec[4] = {};
+		uint64_t sum[4] = {};
+		for (int q(0); q != queries; ++q) {
+			int k(ks[q]);
+			auto s0 = std::chrono::steady_clock::now();
+			auto bits = ::kmin(bx.data(), n, k);
+			auto s1 = std::chrono::steady_clock::now();
+			sum[1] += B.kmin_value(k);
+			auto s2 = std::chrono::steady_clock::now();
+			sum[2] += kmin_nth_element(x.data(), n, k);
+			auto s3 = std::chrono::steady_clock::now();
+			sum[3] += kmin_radix(x.data(), n, l, k);
+			auto s4 = std::chrono::steady_clock::now();
+			for (int i(0); i != l; ++i) sum[0] += uint64_t(bits[i]) << (l - i - 1);
+			sec[0] += std::chrono::duration<double>(s1 - s0).count();
+			sec[1] += std::chrono::duration<double>(s2 - s1).count();
+			sec[2] += std::chrono::duration<double>(s3 - s2).count();
+			sec[3] += std::chrono::duration<double>(s4 - s3).count();
+		}
+		if (sum[0] != sum[1] || sum[0] != sum[2] || sum[0] != sum[3]) wrong = true;
+		const char* names[] = { "kmin (vector<bool>)", "bitsliced_kmin", "nth_element", "radix select" };
+		std::cout << "n = " << n << ", l = " << l << " (bit-slicing: " << std::chrono::duration<double>(t1 - t0).count() * 1e6 << " us)" << std::endl;
+		for (int e(0); e != 4; ++e) std::cout << "    " << names[e] << ": " << sec[e] / queries * 1e6 << " us per query" << std::endl;
+	}
+	if (wrong) std::cout << "test_kmin_reference: wrong." << std::endl;
+	else std::cout << "test_kmin_reference: passed." << std::endl;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*
+* The kmin algorithm (see kmin in kmin_circuit.h) on bit-sliced columns: the fast software reference.
+*
+* The values are stored by bit: column i holds bit i (MSB first) of every value, 64 values per uint64_t.
+* A step of the algorithm is then a sweep over one column: the live zero bits are ~(column | dead), counted by
+* hardware popcount, and the dead mask is updated with one OR per word. A query costs l * n / 64 word operations,
+* against l * n bit operations (on std::vector<bool>) for kmin.
+*
+* Values may be of any length l; kmin_value needs l <= 64.
+*/
+class bitsliced_kmin {
+public:
+	bitsliced_kmin(int n, int l);
+
+	/*
+	* Set bit j (MSB first) of value i.
+	*/
+	void set(int i, int j, bool v);
+
+	/*
+	* Set value i from an integer; l <= 64, the low l bits are used.
+	*/
+	void set_value(int i, uint64_t v);
+
+	/*
+	* Set every value from the input of kmin: x[i] is value i, MSB first.
+	*/
+	void load(const std::vector<bool> x[]);
+
+	/*
+	* Set every value from lane `lane` of a lane-packed batch (see compiled_circuit::eval_batch) of kmin_circuit:
+	* value i is input wires [i * l, (i + 1) * l).
+	*/
+	void load_lane(const uint64_t* input, int words, int lane);
+
+	/*
+	* The k-th min, 1 <= k <= n, MSB first, the same as kmin.
+	* Queries do not modify the oracle, so several threads may query it at once.
+	*/
+	std::vector<bool> kmin(int k) const;
+
+	/*
+	* The same, as an integer; l <= 64.
+	*/
+	uint64_t kmin_value(int k) const;
+
+	int size() const;
+	int length() const;
+
+private:
+	int n, l, words;
+	std::vector<uint64_t> col; // bit i of value 64 * w + b is bit b of col[i * words + w]
+};
+
+/*
+* Selection baselines on packed integers (values below 2^l, l <= 64); both return the k-th smallest, 1 <= k <= n.
+*     kmin_nth_element: std::nth_element on a copy of the values
+*     kmin_radix: MSD radix select with 8-bit digits; each pass counts the digits of the remaining candidates,
+*                 keeps the bucket of the k-th and only those candidates go on to the next digit
+*/
+uint64_t kmin_nth_element(const uint64_t* values, int n, int k);
+uint64_t kmin_radix(const uint64_t* values, int n, int l, int k);
+
+void test_kmin_reference();
@@ -0,0 +1,410 @@
+#include "lut_circuit.h"
+#include "kmin_circuit.h"
+#include "compare_circuit.h"
+#include "selector.h"
+#include "int_adder.h"
+
+#include <algorithm>
+#include <chrono>
+
+/*
+* The truth table of variable t, over 6 variables: bit i is (i >> t) & 1.
+*/
+static const uint64_t _var[6] = { 0xaaaaaaaaaaaaaaaaull, 0xccccccccccccccccull, 0xf0f0f0f0f0f0f0f0ull,
+	0xff00ff00ff00ff00ull, 0xffff0000ffff0000ull, 0xffffffff00000000ull };
+
+/*
+* A cut of a gate: its leaves (sorted gate indices), and the cost of implementing the gate by a LUT on them.
+*/
+struct _cut {
+	int n;
+	int leaf[6];
+	float flow;  // area flow: 1 + the flow of every leaf, divided among the readers of the leaf
+	int depth;   // LUT levels
+};
+
+/*
+* The union of the leaves of a and b, in r; false if it has more than k leaves.
+*/
+static bool _merge(const _cut& a, const _cut& b, _cut& r, int k) {
+	int i(0), j(0);
+	r.n = 0;
+	while (i != a.n || j != b.n) {
+		int x;
+		if (j == b.n || (i != a.n && a.leaf[i] < b.leaf[j])) x = a.leaf[i++];
+		else if (i == a.n || b.leaf[j] < a.leaf[i]) x = b.leaf[j++];
+		else x = a.leaf[i++], ++j;
+		if (r.n == k) return false;
+		r.leaf[r.n++] = x;
+	}
+	return true;
+}
+
+/*
+* Whether the leaves of a are a subset of those of b.
+*/
+static bool _subset(const _cut& a, const _cut& b) {
+	if (a.n > b.n) return false;
+	int j(0);
+	for (int i(0); i != a.n; ++i) {
+		while (j != b.n && b.leaf[j] < a.leaf[i]) ++j;
+		if (j == b.n || b.leaf[j] != a.leaf[i]) return false;
+		++j;
+	}
+	return true;
+}
+
+/*
+* A gate on truth tables.
+*/
+static uint64_t _apply(int t, uint64_t a, uint64_t b, uint64_t c) {
+	switch (t) {
+	case gate::NOT:
+		return ~a;
+	case gate::AND:
+		return a & b;
+	case gate::OR:
+		return a | b;
+	case gate::XOR:
+		return a ^ b;
+	case gate::NAND:
+		return ~(a & b);
+	case gate::NOR:
+		return ~(a | b);
+	case gate::XNOR:
+		return ~(a ^ b);
+	case gate::ANDN:
+		return a & ~b;
+	case gate::MUX:
+		return (a & c) | (~a & b);
+	case gate::MAJ:
+		return (a & b) | (c & (a | b));
+	case gate::ZERO:
+		return 0;
+	case gate::ONE:
+		return ~uint64_t(0);
+	default:
+		throw "Ill-formed compiled circuit.";
+	}
+}
+
+/*
+* The truth table of gate root on its cut; the leaves are stamped with root and hold their variables in val.
+*/
+static uint64_t _cone_table(const compiled_circuit& C, int root, std::vector<uint64_t>& val, std::vector<int>& stamp,
+	std::vector<int>& stack) {
+	const int* in[3] = { C.in0.data(), C.in1.data(), C.in2.data() };
+	stack.assign(1, root);
+	while (!stack.empty()) {
+		int g(stack.back());
+		if (stamp[g] == root) {
+			stack.pop_back();
+			continue;
+		}
+		if (C.type[g] == gate::INPUT) throw "Cut does not separate the gate from the inputs.";
+		int arity(gate::arity(gate::gate_type(C.type[g]))), missing(0);
+		for (int i(0); i != arity; ++i) {
+			if (stamp[in[i][g]] != root) {
+				stack.push_back(in[i][g]);
+				++missing;
+			}
+		}
+		if (missing) continue;
+		uint64_t v[3] = { 0, 0, 0 };
+		for (int i(0); i != arity; ++i) v[i] = val[in[i][g]];
+		val[g] = _apply(C.type[g], v[0], v[1], v[2]);
+		stamp[g] = root;
+		stack.pop_back();
+	}
+	return val[root];
+}
+
+/*
+* Lowers the truth table of one LUT into 3-input instructions of the program of L (see lut_circuit::op_imm).
+*/
+struct _lut_emitter {
+	lut_circuit& L;
+	int base;           // the slot written by instruction 0
+	const int* slot;    // the slots of the leaves
+	std::vector<std::pair<uint64_t, int>> memo;  // the tables already emitted for this LUT
+
+	int op(int a, int b, int c, unsigned char imm) {
+		L.op_a.push_back(a);
+		L.op_b.push_back(b);
+		L.op_c.push_back(c);
+		L.op_imm.push_back(imm);
+		return base + int(L.op_imm.size()) - 1;
+	}
+
+	/*
+	* The slot of the function tt of the first v leaves; tt does not depend on the other variables.
+	*/
+	int emit(uint64_t tt, int v) {
+		for (auto& m : memo) {
+			if (m.first == tt) return m.second;
+		}
+		for (int t(0); t != v; ++t) {
+			if (tt == _var[t]) return slot[t];
+		}
+		int s;
+		if (tt == 0 || tt == ~uint64_t(0)) {
+			// the operands are not read
+			s = op(0, 0, 0, tt ? 0xff : 0x00);
+		} else if (v <= 3) {
+			// leaves 2, 1, 0 are bits 2, 1, 0 of the index; a missing leaf reads another one, as tt ignores it.
+			s = op(slot[std::min(2, v - 1)], slot[std::min(1, v - 1)], slot[0], tt & 0xff);
+		} else {
+			// Shannon expansion on leaf v - 1: MUX(leaf, tt with the leaf 0, tt with the leaf 1)
+			uint64_t p(_var[v - 1]), t0(tt & ~p), t1(tt & p);
+			int sh(1 << (v - 1));
+			t0 |= t0 << sh;
+			t1 |= t1 >> sh;
+			if (t0 == t1) s = emit(t0, v - 1);
+			else {
+				int s0(emit(t0, v - 1)), s1(emit(t1, v - 1));
+				s = op(slot[v - 1], s0, s1, 0xac);
+			}
+		}
+		memo.emplace_back(tt, s);
+		return s;
+	}
+};
+
+lut_circuit::lut_circuit(const compiled_circuit& C, const lut_options& opt)
+	: nin(C.fanin())
+{
+	if (opt.k < 3 || opt.k > 6 || opt.cuts < 1) throw "Invalid LUT options.";
+	const int n(C.gate_count()), k(opt.k);
+	const int* in[3] = { C.in0.data(), C.in1.data(), C.in2.data() };
+	// readers of every gate (outputs included), among which the area flow of its LUT is divided.
+	std::vector<int> refs(n, 0);
+	for (int g(0); g != n; ++g) {
+		for (int i(0); i != 3; ++i) {
+			if (in[i][g] >= 0) ++refs[in[i][g]];
+		}
+	}
+	for (int g : C.out) ++refs[g];
+
+	// Cut enumeration in topological order: the cuts of a gate are the unions of one cut (or the trivial cut,
+	// the gate itself) per input; the best opt.cuts of them by area flow are kept, without dominated ones.
+	// A constant gate only has the empty cut, so constants are always folded into the tables.
+	std::vector<std::vector<_cut>> cuts(n);
+	std::vector<float> flow(n, 0);
+	std::vector<int> level(n, 0);
+	std::vector<_cut> cand, next;
+	for (int g(nin); g != n; ++g) {
+		int t(C.type[g]);
+		if (t == gate::ZERO || t == gate::ONE) {
+			cuts[g].push_back(_cut{ 0, {}, 0, 0 });
+			continue;
+		}
+		cand.assign(1, _cut{ 0, {}, 0, 0 });
+		for (int i(0); i != gate::arity(gate::gate_type(t)); ++i) {
+			int x(in[i][g]);
+			next.clear();
+			for (const _cut& a : cand) {
+				_cut r;
+				for (const _cut& b : cuts[x]) {
+					if (_merge(a, b, r, k)) next.push_back(r);
+				}
+				if (C.type[x] != gate::ZERO && C.type[x] != gate::ONE && _merge(a, _cut{ 1, { x }, 0, 0 }, r, k)) next.push_back(r);
+			}
+			cand.swap(next);
+		}
+		for (_cut& c : cand) {
+			c.flow = 1;
+			c.depth = 0;
+			for (int i(0); i != c.n; ++i) {
+				c.flow += flow[c.leaf[i]] / refs[c.leaf[i]];
+				c.depth = std::max(c.depth, level[c.leaf[i]]);
+			}
+			++c.depth;
+		}
+		std::sort(cand.begin(), cand.end(), [](const _cut& a, const _cut& b) {
+			if (a.flow != b.flow) return a.flow < b.flow;
+			if (a.n != b.n) return a.n < b.n;
+			return a.depth < b.depth;
+		});
+		std::vector<_cut>& kept(cuts[g]);
+		for (const _cut& c : cand) {
+			if (kept.size() == opt.cuts) break;
+			bool dominated(false);
+			for (const _cut& d : kept) {
+				if (_subset(d, c)) {
+					dominated = true;
+					break;
+				}
+			}
+			if (!dominated) kept.push_back(c);
+		}
+		flow[g] = kept[0].flow;
+		level[g] = kept[0].depth;
+	}
+
+	// Cover from the outputs: a gate needed is implemented by its best cut, whose leaves are needed in turn.
+	std::vector<char> need(n, 0);
+	for (int g : C.out) need[g] = 1;
+	for (int g(n - 1); g >= nin; --g) {
+		if (!need[g]) continue;
+		const _cut& c(cuts[g][0]);
+		for (int i(0); i != c.n; ++i) need[c.leaf[i]] = 1;
+	}
+
+	// The LUTs, in the order of their roots; node[g] is the node of gate g.
+	std::vector<int> node(n, -1), lut_level(nin, 0), slot(nin), stack;
+	std::vector<uint64_t> val(n);
+	std::vector<int> stamp(n, -1);
+	for (int g(0); g != nin; ++g) node[g] = slot[g] = g;
+	leaf_begin.push_back(0);
+	for (int g(nin); g != n; ++g) {
+		if (!need[g]) continue;
+		const _cut& c(cuts[g][0]);
+		int lv(0), leaf_slot[6];
+		for (int i(0); i != c.n; ++i) {
+			int x(node[c.leaf[i]]);
+			leaves.push_back(x);
+			leaf_slot[i] = slot[x];
+			lv = std::max(lv, lut_level[x]);
+			val[c.leaf[i]] = _var[i];
+			stamp[c.leaf[i]] = g;
+		}
+		leaf_begin.push_back(leaves.size());
+		table.push_back(_cone_table(C, g, val, stamp, stack));
+		node[g] = nin + int(table.size()) - 1;
+		lut_level.push_back(lv + 1);
+		ndepth = std::max(ndepth, lv + 1);
+		_lut_emitter E{ *this, nin, leaf_slot, {} };
+		slot.push_back(E.emit(table.back(), c.n));
+	}
+	for (int g : C.out) {
+		out.push_back(node[g]);
+		out_slot.push_back(slot[node[g]]);
+	}
+}
+
+std::vector<bool> lut_circuit::eval(const std::vector<bool>& input) const {
+	if (input.size() != fanin()) return {}; // invalid input.
+	std::vector<char> val(nin + lut_count());
+	for (int i(0); i != nin; ++i) val[i] = input[i];
+	for (int j(0); j != lut_count(); ++j) {
+		int index(0);
+		for (int e(leaf_begin[j]); e != leaf_begin[j + 1]; ++e) index |= val[leaves[e]] << (e - leaf_begin[j]);
+		val[nin + j] = (table[j] >> index) & 1;
+	}
+	std::vector<bool> ret;
+	for (int g : out) ret.push_back(val[g]);
+	return ret;
+}
+
+void lut_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words) const {
+	simd_eval(*this, input, output, words, detect_simd());
+}
+
+void lut_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words, simd_level level) const {
+	simd_eval(*this, input, output, words, level);
+}
+
+std::vector<uint64_t> lut_circuit::eval_batch(const std::vector<uint64_t>& input) const {
+	if (fanin() == 0 || input.empty() || input.size() % fanin()) return {}; // invalid input.
+	int words = input.size() / fanin();
+	std::vector<uint64_t> ret(out.size() * words);
+	eval_batch(input.data(), ret.data(), words);
+	return ret;
+}
+
+int lut_circuit::fanin() const {
+	return nin;
+}
+
+int lut_circuit::fanout() const {
+	return out.size();
+}
+
+int lut_circuit::lut_count() const {
+	return table.size();
+}
+
+int lut_circuit::depth() const {
+	return ndepth;
+}
+
+/*
+* Vectors per second of eval_batch on 64 * words random vectors, for at least 0.3 s.
+*/
+template <class E>
+static double _throughput(const E& C, int words, simd_level level) {
+	std::vector<uint64_t> input(C.fanin() * words), output(C.fanout() * words);
+	for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	auto t0 = std::chrono::steady_clock::now();
+	int rounds(0);
+	do {
+		C.eval_batch(input.data(), output.data(), words, level);
+		++rounds;
+	} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(300));
+	return rounds * words * 64 / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void test_lut_circuit() {
+	bool wrong(false);
+	const int words(8);
+	{
+		// small generators, every LUT size and SIMD level, against the gate-level engine.
+		kmin_options csa;
+		csa.popcount = kmin_options::CSA_POPCOUNT;
+		csa.comparator = kmin_options::TREE_COMPARATOR;
+		std::vector<compiled_circuit> cases = { compiled_circuit(compare_circuit(32)), compiled_circuit(tree_less_circuit(32)),
+			compiled_circuit(selector(16)), compiled_circuit(int_adder(32)), compiled_circuit(kmin_circuit(16, 16)),
+			compiled_circuit(kmin_circuit(13, 9, csa)) };
+		for (const compiled_circuit& C : cases) {
+			std::vector<uint64_t> input(C.fanin() * words);
+			for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+			std::vector<uint64_t> expected(C.eval_batch(input)), output(C.fanout() * words);
+			for (int k(3); k <= 6; ++k) {
+				lut_options opt;
+				opt.k = k;
+				lut_circuit L(C, opt);
+				for (int level(SIMD_SCALAR); level <= detect_simd(); ++level) {
+					L.eval_batch(input.data(), output.data(), words, simd_level(level));
+					if (output != expected) wrong = true;
+				}
+				for (int lane(0); lane != 64; ++lane) {
+					std::vector<bool> x(C.fanin());
+					for (int i(0); i != C.fanin(); ++i) x[i] = (input[i * words] >> lane) & 1;
+					if (L.eval(x) != C.eval(x)) wrong = true;
+				}
+			}
+		}
+	}
+	{
+		const int n(100), l(128);
+		compiled_circuit C(kmin_circuit(n, l));
+		std::vector<bool> x(C.fanin());
+		for (int i(0); i != C.fanin(); ++i) x[i] = rand() % 2;
+		auto single = [&](auto& E) {
+			auto t0 = std::chrono::steady_clock::now();
+			int rounds(0);
+			do {
+				E.eval(x);
+				++rounds;
+			} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(300));
+			return rounds / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		};
+		simd_level best(detect_simd());
+		std::cout << "kmin_circuit(" << n << ", " << l << "), eval_batch on " << simd_name(best) << ":" << std::endl;
+		std::cout << "gates: " << C.gate_count() - C.fanin() << " nodes, depth " << C.depth() << ", "
+			<< _throughput(C, 64, best) << " vectors/s; eval " << single(C) << " vectors/s" << std::endl;
+		for (int k : { 3, 4, 6 }) {
+			lut_options opt;
+			opt.k = k;
+			auto t0 = std::chrono::steady_clock::now();
+			lut_circuit L(C, opt);
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			std::cout << k << "-LUT: " << L.lut_count() << " nodes, depth " << L.depth() << ", " << L.op_imm.size()
+				<< " instructions, mapped in " << sec << " s, " << _throughput(L, 64, best) << " vectors/s; eval "
+				<< single(L) << " vectors/s" << std::endl;
+			if (L.eval(x) != C.eval(x)) wrong = true;
+		}
+	}
+	if (wrong) std::cout << "test_lut_circuit: wrong." << std::endl;
+	else std::cout << "test_lut_circuit: passed." << std::endl;
+}
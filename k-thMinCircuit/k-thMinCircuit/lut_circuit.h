@@ -0,0 +1,84 @@
+#pragma once
+#include "compiled_circuit.h"
+#include "simd_kernel.h"
+
+#include <vector>
+#include <cstdint>
+
+struct lut_options {
+	int k = 4;     // inputs per LUT, 3 to 6 (a MUX or MAJ gate may need 3)
+	int cuts = 8;  // cuts kept per gate during enumeration
+};
+
+/*
+* A compiled circuit mapped onto K-input lookup tables (LUTs).
+*
+* Mapping enumerates the K-feasible cuts of every gate (sets of at most K gates separating it from the inputs),
+* keeping the best few by area flow (priority cuts), then covers the circuit from the outputs with the best cut
+* of each gate needed. Each LUT replaces the whole cone between its cut and its root, so the LUT network has fewer
+* nodes and levels than the gate netlist. Constant gates are folded into the truth tables.
+*
+* Nodes are numbered like the gates of a compiled_circuit: [0, fanin) are the inputs, in order; LUT j is node
+* fanin() + j, and the LUTs are in topological order. LUT j reads the nodes leaves[leaf_begin[j], leaf_begin[j + 1]);
+* leaf t is variable t of its truth table, i.e. bit i of table[j] is its value when leaf t is (i >> t) & 1.
+*
+* eval looks the tables up, one vector at a time. eval_batch runs a bit-sliced program instead: every LUT is
+* decomposed (Shannon expansion on its leaves beyond the third) into 3-input functions, each a single ternary-logic
+* instruction (vpternlogq) on AVX-512; the other SIMD levels evaluate a 3-input function as three multiplexers.
+*/
+class lut_circuit {
+public:
+	lut_circuit() = default;
+
+	/*
+	* Map C; it throws if opt is out of range.
+	*/
+	explicit lut_circuit(const compiled_circuit& C, const lut_options& opt = lut_options());
+
+	/*
+	* Same as compiled_circuit::eval, by table lookup.
+	*/
+	std::vector<bool> eval(const std::vector<bool>& input) const;
+
+	/*
+	* Same as compiled_circuit::eval_batch (lane-packed buffers), by the bit-sliced program.
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words) const;
+	void eval_batch(const uint64_t* input, uint64_t* output, int words, simd_level level) const;
+	std::vector<uint64_t> eval_batch(const std::vector<uint64_t>& input) const;
+
+	int fanin() const;
+	int fanout() const;
+
+	/*
+	* Number of LUTs; the inputs are not counted.
+	*/
+	int lut_count() const;
+
+	/*
+	* Number of LUT levels; the inputs are on level 0.
+	*/
+	int depth() const;
+
+	std::vector<int> leaf_begin, leaves;
+	std::vector<uint64_t> table;
+
+	/*
+	* out[j] is the node of the j-th output.
+	*/
+	std::vector<int> out;
+
+	/*
+	* The program run by eval_batch, over slots: slot i < fanin() is input i, and instruction i writes slot
+	* fanin() + i, the function of truth table op_imm[i] on the slots (op_a[i], op_b[i], op_c[i]),
+	* which are bits 2, 1 and 0 of the table index, as in vpternlogq.
+	* out_slot[j] is the slot of the j-th output.
+	*/
+	std::vector<int> op_a, op_b, op_c, out_slot;
+	std::vector<unsigned char> op_imm;
+
+protected:
+	int nin = 0, ndepth = 0;
+};
+
+void test_lut_circuit();
@@ -7,8 +7,25 @@
 #include "compare_circuit.h"
 #include "int_adder.h"
 #include "selector.h"
+#include "compiled_circuit.h"
+#include "simd_kernel.h"
+#include "parallel_eval.h"
+#include "incremental_eval.h"
+#include "circuit_opt.h"
+#include "prefix_adder.h"
+#include "circuit_stats.h"
+#include "native_circuit.h"
+#include "hier_circuit.h"
+#include "netlist_builder.h"
+#include "validator.h"
+#include "stream_eval.h"
+#include "kmin_reference.h"
+#include "fuzz.h"
+#include "lut_circuit.h"
+#include "kmin_pipeline.h"
 
-int main() {
+int main(int argc, char* argv[]) {
+	if (argc > 1) return run_cli(argc, argv); // see stream_eval.h
 	//demo_circuit();
 	//demo_adder();
 	//demo_bitadder();
@@ -20,5 +37,27 @@ int main() {
 	//test_selector();
 	//test_kmin();
 	test_kmin_circuit();
+	//test_compiled_circuit();
+	//test_netlist_file();
+	//test_eval_batch();
+	//test_simd_eval();
+	//test_parallel_eval();
+	//test_incremental_eval();
+	//test_strash();
+	//test_propagate_constants();
+	//test_csa_bitadder();
+	//test_prefix_adder();
+	//test_tree_comparison();
+	//test_circuit_stats();
+	//test_native_circuit();
+	//test_hier_circuit();
+	//test_netlist_builder();
+	//test_remove_void();
+	//test_validator();
+	//test_stream_eval();
+	//test_kmin_reference();
+	//test_fuzz();
+	//test_lut_circuit();
+	//test_kmin_pipeline();
 	return 0;
 }
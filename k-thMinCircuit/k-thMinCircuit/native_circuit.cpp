@@ -0,0 +1,473 @@
+#include "native_circuit.h"
+#include "kmin_circuit.h"
+#include "netlist_builder.h"
+#include "adder_circuit.h"
+
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+extern char** environ;
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+/*
+* Bump this whenever the generated code changes, so that old libraries in the cache are not used.
+*/
+static const int _codegen_version = 3;
+
+/*
+* The compiler command, as words: $KMC_CXX split at spaces (default "c++"), then the flags.
+* It is run without a shell, so no word is ever interpreted.
+*/
+static std::vector<std::string> _compiler() {
+	const char* cxx = std::getenv("KMC_CXX");
+	std::istringstream words(cxx ? cxx : "");
+	std::vector<std::string> ret;
+	for (std::string w; words >> w; ) ret.push_back(w);
+	if (ret.empty()) ret.push_back("c++");
+	for (const char* f : { "-std=c++11", "-O1", "-march=native", "-fPIC", "-shared", "-w" }) ret.push_back(f);
+	return ret;
+}
+
+static void _fnv(uint64_t& h, const void* data, size_t len) {
+	const unsigned char* p((const unsigned char*)data);
+	for (size_t i(0); i != len; ++i) {
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+}
+
+/*
+* Mix the instruction set of this machine into h. The libraries are built with -march=native, so one built on another
+* machine sharing the cache may not run here. That is the SIMD level, and on x86 the vendor, the CPU signature and
+* the feature words of CPUID (leaves 1 and 7), which are what -march=native resolves to.
+*/
+static void _host_isa(uint64_t& h) {
+	int level(detect_simd());
+	_fnv(h, &level, sizeof(level));
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	unsigned int r[4] = { 0, 0, 0, 0 }, nid(0);
+	if (__get_cpuid(0, &nid, &r[1], &r[2], &r[3])) _fnv(h, r, sizeof(r));
+	if (__get_cpuid(1, &r[0], &r[1], &r[2], &r[3])) {
+		r[1] = 0; // brand index, CLFLUSH size, APIC id: they differ between the cores
+		_fnv(h, r, sizeof(r));
+	}
+	if (nid >= 7 && __get_cpuid_count(7, 0, &r[0], &r[1], &r[2], &r[3])) _fnv(h, r, sizeof(r));
+#endif
+}
+
+uint64_t native_circuit::hash(const compiled_circuit& C) {
+	uint64_t h(0xcbf29ce484222325ull);
+	int head[3] = { _codegen_version, C.gate_count(), C.fanin() };
+	_fnv(h, head, sizeof(head));
+	_fnv(h, C.type.data(), C.type.size());
+	_fnv(h, C.in0.data(), C.in0.size() * sizeof(int));
+	_fnv(h, C.in1.data(), C.in1.size() * sizeof(int));
+	_fnv(h, C.in2.data(), C.in2.size() * sizeof(int));
+	_fnv(h, C.out.data(), C.out.size() * sizeof(int));
+	for (const std::string& w : _compiler()) _fnv(h, w.c_str(), w.size() + 1);
+	_host_isa(h);
+	return h;
+}
+
+/*
+* Gates per generated function. The register allocator of the compiler is superlinear in the size of a function,
+* so the sweep is cut into functions of this many gates, which pass the values alive across them in an array.
+*/
+static const int _segment_gates = 2048;
+
+std::string native_circuit::source(const compiled_circuit& C) {
+	const int ngate(C.gate_count()), nin(C.fanin());
+	// The last gate reading each gate; an output is read at the very end.
+	std::vector<int> last(ngate, -1);
+	for (int g(nin); g != ngate; ++g) {
+		if (C.in0[g] >= 0) last[C.in0[g]] = g;
+		if (C.in1[g] >= 0) last[C.in1[g]] = g;
+		if (C.in2[g] >= 0) last[C.in2[g]] = g;
+	}
+	std::vector<std::vector<int>> outputs_of(ngate);
+	for (int j(0); j != C.fanout(); ++j) outputs_of[C.out[j]].push_back(j);
+
+	// Temporaries: var[g] is the temporary holding gate g, freed after last[g].
+	// An INPUT gate is loaded right before its first use.
+	// Within a segment the temporaries are locals; across segments they live in s[var].
+	std::vector<int> var(ngate, -1), seg_of(ngate, -1), free_vars, holder;
+	std::vector<std::vector<int>> dies(ngate);
+	int nseg(0);
+	std::ostringstream body, src;
+	std::vector<char> declared;
+	auto alloc = [&](int g) {
+		if (free_vars.empty()) {
+			var[g] = holder.size();
+			holder.push_back(-1);
+			declared.push_back(0);
+		} else {
+			var[g] = free_vars.back();
+			free_vars.pop_back();
+		}
+		holder[var[g]] = g;
+		declared[var[g]] = 1;
+		seg_of[g] = nseg;
+		if (last[g] >= 0) dies[last[g]].push_back(g);
+	};
+	auto release = [&](int g) {
+		holder[var[g]] = -1;
+		free_vars.push_back(var[g]);
+	};
+	auto operand = [&](int g) {
+		if (var[g] < 0) {
+			// an INPUT gate not loaded yet
+			alloc(g);
+			body << "\tmemcpy(&t" << var[g] << ", in + " << g << " * words, sizeof(T));\n";
+		} else if (seg_of[g] != nseg) {
+			// alive from an earlier segment
+			seg_of[g] = nseg;
+			declared[var[g]] = 1;
+			body << "\tt" << var[g] << " = s[" << var[g] << "];\n";
+		}
+		return "t" + std::to_string(var[g]);
+	};
+	auto flush = [&]() {
+		// store the values of this segment that are still alive, then emit the function
+		for (int v(0); v != holder.size(); ++v) {
+			if (holder[v] >= 0 && seg_of[holder[v]] == nseg) body << "\ts[" << v << "] = t" << v << ";\n";
+		}
+		src << "static KMC_NOINLINE void segment" << nseg << "(const uint64_t* in, uint64_t* out, int words, T* s) {\n"
+			<< "\tconst T zero = {};\n\t(void)zero;\n\tT";
+		bool first(true);
+		for (int v(0); v != declared.size(); ++v) {
+			if (!declared[v]) continue;
+			src << (first ? " t" : ", t") << v;
+			first = false;
+			declared[v] = 0;
+		}
+		if (first) src << " t_unused";
+		src << ";\n" << body.str() << "}\n\n";
+		body.str("");
+		++nseg;
+	};
+
+	src << "// generated from a netlist of " << ngate << " gates, " << nin << " inputs, " << C.fanout() << " outputs\n"
+		<< "#include <stdint.h>\n#include <string.h>\n#include <stdlib.h>\n\n"
+		<< "#if defined(__GNUC__)\n"
+		<< "#if defined(__AVX512F__)\n#define KMC_W 8\n#elif defined(__AVX2__)\n#define KMC_W 4\n#else\n#define KMC_W 2\n#endif\n"
+		<< "typedef uint64_t T __attribute__((vector_size(8 * KMC_W)));\n"
+		<< "#define KMC_NOINLINE __attribute__((noinline))\n"
+		<< "#else\n#define KMC_W 1\ntypedef uint64_t T;\n#define KMC_NOINLINE\n#endif\n\n";
+	for (int g(nin); g != ngate; ++g) {
+		std::string a, b, c;
+		if (C.in0[g] >= 0) a = operand(C.in0[g]);
+		if (C.in1[g] >= 0) b = operand(C.in1[g]);
+		if (C.in2[g] >= 0) c = operand(C.in2[g]);
+		// the inputs dying here are freed first, so that g may take over one of their temporaries
+		for (int d : dies[g]) release(d);
+		alloc(g);
+		std::string t("t" + std::to_string(var[g]));
+		switch (C.type[g]) {
+		case gate::NOT:
+			body << "\t" << t << " = ~" << a << ";\n";
+			break;
+		case gate::AND:
+			body << "\t" << t << " = " << a << " & " << b << ";\n";
+			break;
+		case gate::OR:
+			body << "\t" << t << " = " << a << " | " << b << ";\n";
+			break;
+		case gate::XOR:
+			body << "\t" << t << " = " << a << " ^ " << b << ";\n";
+			break;
+		case gate::NAND:
+			body << "\t" << t << " = ~(" << a << " & " << b << ");\n";
+			break;
+		case gate::NOR:
+			body << "\t" << t << " = ~(" << a << " | " << b << ");\n";
+			break;
+		case gate::XNOR:
+			body << "\t" << t << " = ~(" << a << " ^ " << b << ");\n";
+			break;
+		case gate::ANDN:
+			body << "\t" << t << " = " << a << " & ~" << b << ";\n";
+			break;
+		case gate::MUX:
+			body << "\t" << t << " = (" << a << " & " << c << ") | (~" << a << " & " << b << ");\n";
+			break;
+		case gate::MAJ:
+			body << "\t" << t << " = (" << a << " & " << b << ") | (" << c << " & (" << a << " | " << b << "));\n";
+			break;
+		case gate::ZERO:
+			body << "\t" << t << " = zero;\n";
+			break;
+		case gate::ONE:
+			body << "\t" << t << " = ~zero;\n";
+			break;
+		default:
+			throw "Ill-formed compiled circuit.";
+		}
+		for (int j : outputs_of[g]) body << "\tmemcpy(out + " << j << " * words, &" << t << ", sizeof(T));\n";
+		if (last[g] < 0) release(g);
+		if ((g - nin + 1) % _segment_gates == 0) flush();
+	}
+	// outputs that are INPUT gates
+	for (int g(0); g != nin; ++g) {
+		for (int j : outputs_of[g]) body << "\tmemcpy(out + " << j << " * words, in + " << g << " * words, sizeof(T));\n";
+	}
+	flush();
+
+	// The values alive across segments and the tail buffers are on the heap: for a big netlist they would not fit
+	// in the stack of the calling thread.
+	src << "// evaluate the KMC_W words of the batch starting at in, out; s holds the values alive across segments\n"
+		<< "static void block(const uint64_t* in, uint64_t* out, int words, T* s) {\n";
+	for (int k(0); k != nseg; ++k) src << "\tsegment" << k << "(in, out, words, s);\n";
+	src << "}\n\n"
+		<< "// 0 on success, 1 if out of memory\n"
+		<< "extern \"C\" int kmc_eval(const uint64_t* in, uint64_t* out, int words, int begin, int end) {\n"
+		<< "\tvoid* s;\n"
+		<< "\tif (posix_memalign(&s, 64, sizeof(T) * " << holder.size() + 1 << ")) return 1;\n"
+		<< "\tint w = begin;\n"
+		<< "\tfor (; w + KMC_W <= end; w += KMC_W) block(in + w, out + w, words, (T*)s);\n"
+		<< "\tif (w != end) {\n"
+		<< "\t\t// the tail: gather it into full blocks, padded with 0\n"
+		<< "\t\tuint64_t* tin = (uint64_t*)calloc(" << nin << " * KMC_W + 1, 8);\n"
+		<< "\t\tuint64_t* tout = (uint64_t*)malloc((" << C.fanout() << " * KMC_W + 1) * 8);\n"
+		<< "\t\tif (!tin || !tout) {\n"
+		<< "\t\t\tfree(tin);\n\t\t\tfree(tout);\n\t\t\tfree(s);\n\t\t\treturn 1;\n\t\t}\n"
+		<< "\t\tfor (int i = 0; i != " << nin << "; ++i) memcpy(tin + i * KMC_W, in + i * words + w, (end - w) * 8);\n"
+		<< "\t\tblock(tin, tout, KMC_W, (T*)s);\n"
+		<< "\t\tfor (int j = 0; j != " << C.fanout() << "; ++j) memcpy(out + j * words + w, tout + j * KMC_W, (end - w) * 8);\n"
+		<< "\t\tfree(tin);\n\t\tfree(tout);\n"
+		<< "\t}\n"
+		<< "\tfree(s);\n"
+		<< "\treturn 0;\n"
+		<< "}\n";
+	return src.str();
+}
+
+#if !defined(_WIN32)
+/*
+* The default cache directory: $XDG_CACHE_HOME/kmc, else $HOME/.cache/kmc, else /tmp/kmc_cache-<uid>.
+*/
+static std::string _default_cache_dir() {
+	// the parent directory is created if missing; if that fails, so does the cache directory
+	const char* xdg = std::getenv("XDG_CACHE_HOME");
+	if (xdg && xdg[0] == '/') {
+		mkdir(xdg, 0700);
+		return std::string(xdg) + "/kmc";
+	}
+	const char* home = std::getenv("HOME");
+	if (home && home[0] == '/') {
+		mkdir((std::string(home) + "/.cache").c_str(), 0700);
+		return std::string(home) + "/.cache/kmc";
+	}
+	return "/tmp/kmc_cache-" + std::to_string(geteuid());
+}
+
+/*
+* Whether path (not followed if a symbolic link) is owned by this user and not writable by anyone else:
+* only then may a library in the cache be loaded, since it is run as is.
+*/
+static bool _private(const std::string& path, bool directory) {
+	struct stat st;
+	if (lstat(path.c_str(), &st) != 0) return false;
+	if (directory ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode)) return false;
+	return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/*
+* Run a command (no shell), and return its exit status; -1 if it could not be run or did not exit.
+*/
+static int _spawn(const std::vector<std::string>& args) {
+	std::vector<char*> argv;
+	for (const std::string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+	argv.push_back(nullptr);
+	pid_t pid;
+	if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return -1;
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return -1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+native_circuit::native_circuit(const compiled_circuit& C, const std::string& cache_dir)
+	: nin(C.fanin()), nout(C.fanout())
+{
+#if defined(_WIN32)
+	throw "native_circuit is not supported on this platform.";
+#else
+	std::string dir(cache_dir);
+	if (dir.empty()) {
+		const char* env = std::getenv("KMC_CACHE_DIR");
+		dir = env && *env ? env : _default_cache_dir();
+	}
+	if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) throw "Cannot create the cache directory.";
+	if (!_private(dir, true)) throw "The cache directory is not a directory private to this user.";
+	char name[32];
+	std::snprintf(name, sizeof(name), "kmc_%016llx", (unsigned long long)hash(C));
+	lib = dir + "/" + name + ".so";
+
+	struct stat st;
+	hit = (lstat(lib.c_str(), &st) == 0);
+	if (hit && !_private(lib, false)) throw "The cached library is not private to this user.";
+	if (!hit) {
+		// build under a unique name, then rename: concurrent builders never see a partial library.
+		std::string tmp(dir + "/" + name + "." + std::to_string(getpid()));
+		{
+			std::ofstream file(tmp + ".cpp");
+			if (!file) throw "Cannot write the generated source.";
+			file << source(C);
+		}
+		std::vector<std::string> cmd(_compiler());
+		cmd.insert(cmd.end(), { "-o", tmp + ".so", tmp + ".cpp" });
+		int ret = _spawn(cmd);
+		std::remove((tmp + ".cpp").c_str());
+		if (ret != 0 || std::rename((tmp + ".so").c_str(), lib.c_str()) != 0) {
+			std::remove((tmp + ".so").c_str());
+			throw "Failed to build the generated code.";
+		}
+	}
+	void* h = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!h) throw "Failed to load the generated code.";
+	handle = std::shared_ptr<void>(h, [](void* h) { dlclose(h); });
+	fn = (entry)dlsym(h, "kmc_eval");
+	if (!fn) throw "Generated code has no entry point.";
+#endif
+}
+
+void native_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words) const {
+	eval_batch(input, output, words, 0, words);
+}
+
+void native_circuit::eval_batch(const uint64_t* input, uint64_t* output, int words, int begin, int end) const {
+	if (fn(input, output, words, begin, end)) throw "Out of memory.";
+}
+
+std::vector<uint64_t> native_circuit::eval_batch(const std::vector<uint64_t>& input) const {
+	if (nin == 0 || input.empty() || input.size() % nin) return {}; // invalid input.
+	int words = input.size() / nin;
+	std::vector<uint64_t> ret(nout * words);
+	eval_batch(input.data(), ret.data(), words);
+	return ret;
+}
+
+int native_circuit::fanin() const {
+	return nin;
+}
+
+int native_circuit::fanout() const {
+	return nout;
+}
+
+bool native_circuit::cached() const {
+	return hit;
+}
+
+std::string native_circuit::path() const {
+	return lib;
+}
+
+void test_native_circuit() {
+	const int nl[][2] = { {16, 32}, {100, 32} }; // kmin_circuit(100, 128) takes about a minute to build
+	const int words(67); // not a multiple of the vector width, to test the tail
+	bool wrong(false);
+	for (auto p : nl) {
+		int n(p[0]), l(p[1]);
+		kmin_circuit C(n, l);
+		compiled_circuit CC(C);
+		auto t0 = std::chrono::steady_clock::now();
+		native_circuit N(CC);
+		double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		t0 = std::chrono::steady_clock::now();
+		native_circuit M(CC);
+		double reload = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (!M.cached()) wrong = true;
+
+		std::vector<uint64_t> input(CC.fanin() * words), ref(CC.fanout() * words), output(CC.fanout() * words);
+		for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+		CC.eval_batch(input.data(), ref.data(), words);
+		N.eval_batch(input.data(), output.data(), words);
+		if (output != ref) wrong = true;
+
+		double sec[2];
+		for (int v(0); v != 2; ++v) {
+			int rounds(0);
+			t0 = std::chrono::steady_clock::now();
+			do {
+				if (v == 0) CC.eval_batch(input.data(), output.data(), words);
+				else N.eval_batch(input.data(), output.data(), words);
+				++rounds;
+			} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(300));
+			sec[v] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / rounds;
+		}
+		std::cout << "kmin_circuit(" << n << ", " << l << "): " << (N.cached() ? "loaded" : "built") << " in " << build
+			<< " s, reloaded in " << reload * 1e3 << " ms; " << simd_name(detect_simd()) << " " << words * 64 / sec[0]
+			<< " vectors/s, native " << words * 64 / sec[1] << " vectors/s" << std::endl;
+	}
+	{
+		// A large fan-in: the inputs of a block and of the tail are far beyond the default stack (8 MB).
+		const int nin(300000);
+		netlist_builder B;
+		std::vector<int> x;
+		for (int i(0); i != nin; ++i) x.push_back(B.input());
+		B.output(B.op_and(x[0], x[nin - 1]));
+		B.output(B.op_xor(x[1], x[nin / 2]));
+		compiled_circuit CC(B.build());
+		native_circuit N(CC);
+		for (int words : { 8, 3 }) {
+			std::vector<uint64_t> input(size_t(nin) * words), ref(CC.fanout() * words), output(CC.fanout() * words);
+			for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+			CC.eval_batch(input.data(), ref.data(), words);
+			N.eval_batch(input.data(), output.data(), words);
+			if (output != ref) {
+				std::cout << "native_circuit with " << nin << " inputs, " << words << " words: wrong." << std::endl;
+				wrong = true;
+			}
+		}
+	}
+#if !defined(_WIN32)
+	{
+		// A cache directory with spaces and shell metacharacters, and the checks on the cache.
+		char base[] = "/tmp/kmc_test_XXXXXX";
+		if (!mkdtemp(base)) throw "Cannot create a temporary directory.";
+		std::string dir(std::string(base) + "/a b;$(false)'");
+		adder_circuit A;
+		compiled_circuit CC(A);
+		native_circuit N(CC, dir);
+		std::vector<uint64_t> input(CC.fanin() * 5);
+		for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+		if (N.eval_batch(input) != CC.eval_batch(input)) wrong = true;
+		auto refused = [&](const std::string& d) {
+			try {
+				native_circuit M(CC, d);
+				return false;
+			} catch (const char*) {
+				return true;
+			}
+		};
+		// a library writable by others, then a cache directory writable by others, are not trusted
+		chmod(N.path().c_str(), 0666);
+		if (!refused(dir)) wrong = true;
+		chmod(N.path().c_str(), 0755);
+		chmod(dir.c_str(), 0777);
+		if (!refused(dir)) wrong = true;
+		std::remove(N.path().c_str());
+		rmdir(dir.c_str());
+		rmdir(base);
+	}
+#endif
+	if (wrong) std::cout << "test_native_circuit: wrong." << std::endl;
+	else std::cout << "test_native_circuit: passed." << std::endl;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+/*
+* A circuit compiled to machine code: the netlist is emitted as a straight-line C++ function,
+* one statement per gate in topological order, built by the system compiler into a shared library, and loaded with dlopen.
+* There is no interpretation left at all; the compiler keeps the values in registers as far as it can.
+*
+* The generated function evaluates a lane-packed batch, with the same layout as compiled_circuit::eval_batch.
+* It works on the widest vector type of the machine it is built on (-march=native, GCC / clang vector extensions).
+* The temporaries are reused as soon as their gate is dead, so the function only declares as many of them
+* as there are values alive at a time.
+*
+* The libraries are cached in a directory, by a hash of the netlist (and of the compiler command and the host CPU):
+* building the same circuit again only costs a dlopen.
+* The compiler is taken from the environment variable KMC_CXX (default "c++"; split at spaces, run without a shell),
+* the cache directory from KMC_CACHE_DIR unless given, else $XDG_CACHE_HOME/kmc, $HOME/.cache/kmc or
+* /tmp/kmc_cache-<uid>. A cached library is loaded and run as is, so the directory is created with mode 0700, and
+* the constructor throws if the directory or the library is not owned by this user or is writable by others.
+*
+* POSIX only; on other platforms the constructor throws.
+*/
+class native_circuit {
+public:
+	explicit native_circuit(const compiled_circuit& C, const std::string& cache_dir = "");
+
+	/*
+	* The same as compiled_circuit::eval_batch. It is safe to call it concurrently.
+	* The values are kept on the heap, whatever the size of the netlist; it throws if they cannot be allocated.
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words) const;
+
+	/*
+	* Evaluate only words [begin, end) of the batch, the buffers being still laid out with stride "words".
+	*/
+	void eval_batch(const uint64_t* input, uint64_t* output, int words, int begin, int end) const;
+
+	std::vector<uint64_t> eval_batch(const std::vector<uint64_t>& input) const;
+
+	int fanin() const;
+	int fanout() const;
+
+	/*
+	* Whether the library was found in the cache, rather than built.
+	*/
+	bool cached() const;
+
+	/*
+	* The path of the shared library.
+	*/
+	std::string path() const;
+
+	/*
+	* The generated C++ source.
+	*/
+	static std::string source(const compiled_circuit& C);
+
+	/*
+	* The hash the cache is keyed by.
+	*/
+	static uint64_t hash(const compiled_circuit& C);
+
+private:
+	typedef int (*entry)(const uint64_t*, uint64_t*, int, int, int);
+	entry fn = nullptr;
+	std::shared_ptr<void> handle;
+	int nin = 0, nout = 0;
+	bool hit = false;
+	std::string lib;
+};
+
+void test_native_circuit();
@@ -0,0 +1,340 @@
+#include "netlist_builder.h"
+#include "kmin_circuit.h"
+
+#include <algorithm>
+#include <chrono>
+
+int netlist_builder::input() {
+	type.push_back(gate::INPUT);
+	in0.push_back(-1);
+	in1.push_back(-1);
+	in2.push_back(-1);
+	level.push_back(0);
+	++nin;
+	return type.size() - 1;
+}
+
+int netlist_builder::constant(bool v) {
+	if (constants[v] < 0) {
+		constants[v] = type.size();
+		type.push_back(v ? gate::ONE : gate::ZERO);
+		in0.push_back(-1);
+		in1.push_back(-1);
+		in2.push_back(-1);
+		// constant gates are on level 1, so that level 0 only holds INPUT gates.
+		level.push_back(1);
+	}
+	return constants[v];
+}
+
+bool netlist_builder::is_const(int w) const {
+	return w == constants[0] || w == constants[1];
+}
+
+int netlist_builder::negate(int a) {
+	if (type[a] == gate::NOT) return in0[a];
+	return add(gate::NOT, a);
+}
+
+int netlist_builder::fold_extended(gate::gate_type t, int a, int b, int c) {
+	// the same rules as propagate_constants, see there.
+	int arity(gate::arity(t));
+	bool all(true), any(false);
+	for (int i(0); i != arity; ++i) {
+		int w(i == 0 ? a : i == 1 ? b : c);
+		all = all && is_const(w);
+		any = any || is_const(w);
+	}
+	if (!any) return -1;
+	auto v = [this](int w) { return w == constants[1]; };
+	if (all) return constant(gate::apply(t, v(a), arity > 1 && v(b), arity > 2 && v(c)));
+	switch (t) {
+	case gate::NAND:
+	case gate::NOR:
+	case gate::XNOR:
+		if (!is_const(b)) std::swap(a, b);
+		if (t == gate::NAND) return v(b) ? negate(a) : constant(true);
+		if (t == gate::NOR) return v(b) ? constant(false) : negate(a);
+		return v(b) ? a : negate(a);
+	case gate::ANDN:
+		if (is_const(b)) return v(b) ? constant(false) : a;
+		return v(a) ? negate(b) : constant(false);
+	case gate::MUX:
+		if (is_const(a)) return v(a) ? c : b;
+		if (is_const(b) && is_const(c)) return v(b) == v(c) ? b : (v(c) ? a : negate(a));
+		if (is_const(b)) return v(b) ? add(gate::OR, negate(a), c) : add(gate::AND, a, c);
+		return v(c) ? add(gate::OR, a, b) : add(gate::ANDN, b, a);
+	case gate::MAJ: {
+		int in[3] = { a, b, c };
+		std::stable_partition(in, in + 3, [this](int w) { return !is_const(w); });
+		if (is_const(in[1])) return v(in[1]) == v(in[2]) ? in[1] : in[0];
+		return add(v(in[2]) ? gate::OR : gate::AND, in[0], in[1]);
+	}
+	default:
+		throw "Unknown gate.";
+	}
+}
+
+int netlist_builder::add(gate::gate_type t, int a, int b, int c) {
+	int arity(gate::arity(t));
+	if (arity == 0 || t >= gate::END_OF_TYPE) throw "Invalid gate type.";
+	if (arity < 2) b = -1;
+	if (arity < 3) c = -1;
+	for (int i(0); i != arity; ++i) {
+		int w(i == 0 ? a : i == 1 ? b : c);
+		if (w < 0 || w >= type.size()) throw "Wire out of range.";
+	}
+	// fold constants, the same way as propagate_constants
+	if (t == gate::NOT) {
+		if (is_const(a)) return constant(a == constants[0]);
+	} else if (t != gate::AND && t != gate::OR && t != gate::XOR) {
+		int r(fold_extended(t, a, b, c));
+		if (r >= 0) return r;
+	} else {
+		if (!is_const(b)) std::swap(a, b);
+		if (is_const(b)) {
+			bool v(b == constants[1]);
+			if (is_const(a)) {
+				bool u(a == constants[1]);
+				switch (t) {
+				case gate::AND:
+					return constant(u && v);
+				case gate::OR:
+					return constant(u || v);
+				case gate::XOR:
+					return constant(u != v);
+				default:
+					throw "Unknown gate.";
+				}
+			}
+			switch (t) {
+			case gate::AND:
+				return v ? a : constant(false);
+			case gate::OR:
+				return v ? constant(true) : a;
+			case gate::XOR:
+				if (!v) return a;
+				if (type[a] == gate::NOT) return in0[a];
+				return add(gate::NOT, a);
+			default:
+				throw "Unknown gate.";
+			}
+		}
+	}
+	type.push_back(t);
+	in0.push_back(a);
+	in1.push_back(b);
+	in2.push_back(c);
+	level.push_back(std::max({ level[a], b < 0 ? 0 : level[b], c < 0 ? 0 : level[c] }) + 1);
+	return type.size() - 1;
+}
+
+int netlist_builder::op_not(int a) {
+	return add(gate::NOT, a);
+}
+
+int netlist_builder::op_and(int a, int b) {
+	return add(gate::AND, a, b);
+}
+
+int netlist_builder::op_or(int a, int b) {
+	return add(gate::OR, a, b);
+}
+
+int netlist_builder::op_xor(int a, int b) {
+	return add(gate::XOR, a, b);
+}
+
+int netlist_builder::op_nand(int a, int b) {
+	return add(gate::NAND, a, b);
+}
+
+int netlist_builder::op_nor(int a, int b) {
+	return add(gate::NOR, a, b);
+}
+
+int netlist_builder::op_xnor(int a, int b) {
+	return add(gate::XNOR, a, b);
+}
+
+int netlist_builder::op_andn(int a, int b) {
+	return add(gate::ANDN, a, b);
+}
+
+int netlist_builder::op_mux(int s, int a, int b) {
+	return add(gate::MUX, s, a, b);
+}
+
+int netlist_builder::op_maj(int a, int b, int c) {
+	return add(gate::MAJ, a, b, c);
+}
+
+void netlist_builder::output(int w) {
+	if (w < 0 || w >= type.size()) throw "Wire out of range.";
+	out.push_back(w);
+}
+
+int netlist_builder::size() const {
+	return type.size();
+}
+
+compiled_circuit netlist_builder::build() {
+	int n(type.size());
+	// Mark from the outputs; the gates are in topological order, so one backward sweep is enough.
+	std::vector<char> live(n, 0);
+	for (int w : out) live[w] = 1;
+	for (int g(n - 1); g >= 0; --g) {
+		if (type[g] == gate::INPUT) live[g] = 1;
+		if (!live[g]) continue;
+		if (in0[g] >= 0) live[in0[g]] = 1;
+		if (in1[g] >= 0) live[in1[g]] = 1;
+		if (in2[g] >= 0) live[in2[g]] = 1;
+	}
+	// Counting sort of the live gates by level; INPUT gates come first, in order.
+	int nlevel(1);
+	for (int g(0); g != n; ++g) {
+		if (live[g]) nlevel = std::max(nlevel, level[g] + 1);
+	}
+	std::vector<int> level_begin(nlevel + 1, 0);
+	for (int g(0); g != n; ++g) {
+		if (live[g]) ++level_begin[level[g] + 1];
+	}
+	for (int d(0); d != nlevel; ++d) level_begin[d + 1] += level_begin[d];
+	std::vector<int> pos(level_begin.begin(), level_begin.end() - 1), rank(n, -1);
+	for (int g(0); g != n; ++g) {
+		if (live[g]) rank[g] = pos[level[g]]++;
+	}
+	int m(level_begin.back());
+	std::vector<unsigned char> t(m);
+	std::vector<int> a(m, -1), b(m, -1), c(m, -1), o;
+	for (int g(0); g != n; ++g) {
+		if (!live[g]) continue;
+		t[rank[g]] = type[g];
+		if (in0[g] >= 0) a[rank[g]] = rank[in0[g]];
+		if (in1[g] >= 0) b[rank[g]] = rank[in1[g]];
+		if (in2[g] >= 0) c[rank[g]] = rank[in2[g]];
+	}
+	for (int w : out) o.push_back(rank[w]);
+	*this = netlist_builder();
+	return compiled_circuit::assemble(std::move(t), std::move(a), std::move(b), std::move(c), std::move(level_begin), std::move(o));
+}
+
+std::vector<int> build_adder(netlist_builder& B, int a, int b, int c) {
+	return { B.op_xor(B.op_xor(a, b), c), B.op_maj(a, b, c) };
+}
+
+std::vector<int> build_bitadder(netlist_builder& B, const std::vector<int>& bits) {
+	int n(bits.size());
+	if (n == 1) throw "Cannot create a vacuous bitadder.";
+	if (n == 2) return { B.op_xor(bits[0], bits[1]), B.op_and(bits[0], bits[1]) };
+	if (n == 3) return build_adder(B, bits[0], bits[1], bits[2]);
+	std::vector<int> s1(build_bitadder(B, { bits.begin(), bits.begin() + n / 2 }));
+	std::vector<int> s2(build_bitadder(B, { bits.begin() + n / 2, bits.end() }));
+	std::vector<int> ret(_count_bits(n));
+	ret[0] = B.op_xor(s1[0], s2[0]);
+	int carry(B.op_and(s1[0], s2[0]));
+	int i(1);
+	for (; i != s2.size(); ++i) {
+		if (i < s1.size()) {
+			auto r = build_adder(B, s1[i], s2[i], carry);
+			ret[i] = r[0];
+			carry = r[1];
+		} else {
+			ret[i] = B.op_xor(carry, s2[i]);
+			carry = B.op_and(carry, s2[i]);
+		}
+	}
+	if (i != ret.size()) ret[i] = carry;
+	return ret;
+}
+
+std::vector<int> build_int_adder(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b) {
+	int n(a.size());
+	std::vector<int> ret(n);
+	if (n == 1) return { B.op_xor(a[0], b[0]) };
+	ret[n - 1] = B.op_xor(a[n - 1], b[n - 1]);
+	int carry(B.op_and(a[n - 1], b[n - 1]));
+	int i(n - 2);
+	for (; i > 0; --i) {
+		auto r = build_adder(B, a[i], b[i], carry);
+		ret[i] = r[0];
+		carry = r[1];
+	}
+	ret[i] = B.op_xor(B.op_xor(a[i], b[i]), carry);
+	return ret;
+}
+
+int build_less(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b) {
+	int n(a.size());
+	std::vector<int> gval(n);
+	for (int i(0); i != n; ++i) gval[i] = B.op_xor(a[i], b[i]);
+	for (int i(1); i != n; ++i) gval[i] = B.op_or(gval[i - 1], gval[i]);
+	std::vector<int> first(n);
+	first[0] = gval[0];
+	for (int i(1); i != n; ++i) first[i] = B.op_xor(gval[i - 1], gval[i]);
+	for (int i(0); i != n; ++i) first[i] = B.op_and(first[i], b[i]);
+	for (int i(1); i != n; ++i) first[i] = B.op_or(first[i - 1], first[i]);
+	return first[n - 1];
+}
+
+std::vector<int> build_selector(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b, int s) {
+	std::vector<int> ret;
+	for (int i(0); i != a.size(); ++i) ret.push_back(B.op_mux(s, a[i], b[i]));
+	return ret;
+}
+
+compiled_circuit build_kmin(int n, int l) {
+	int logn(_count_bits(n));
+	netlist_builder B;
+	std::vector<int> x(n * l), k(logn);
+	for (int& w : x) w = B.input();
+	for (int& w : k) w = B.input();
+	std::vector<int> dead(n, B.constant(false)), strict_less(logn, B.constant(false));
+	// the same as kmin_stage, see there.
+	for (int i(0); i != l; ++i) {
+		std::vector<int> zeros(n);
+		for (int j(0); j != n; ++j) zeros[j] = B.op_nor(x[j * l + i], dead[j]);
+		std::vector<int> cnt(build_bitadder(B, zeros));
+		cnt = std::vector<int>(cnt.rbegin(), cnt.rend()); // to big endian
+		std::vector<int> sum(build_int_adder(B, strict_less, cnt));
+		int lesser(build_less(B, sum, k));
+		B.output(lesser);
+		strict_less = build_selector(B, strict_less, sum, lesser);
+		for (int j(0); j != n; ++j) dead[j] = B.op_or(dead[j], B.op_xnor(zeros[j], lesser));
+	}
+	return B.build();
+}
+
+void test_netlist_builder() {
+	bool wrong(false);
+	{
+		const int n(100), l(128);
+		auto t0 = std::chrono::steady_clock::now();
+		compiled_circuit A(kmin_circuit(n, l));
+		auto t1 = std::chrono::steady_clock::now();
+		compiled_circuit B(build_kmin(n, l));
+		auto t2 = std::chrono::steady_clock::now();
+		std::cout << "kmin(" << n << ", " << l << "): kmin_circuit + compile " << std::chrono::duration<double>(t1 - t0).count()
+			<< " s, size " << A.size() << "; netlist_builder " << std::chrono::duration<double>(t2 - t1).count() << " s, size " << B.size() << std::endl;
+		// the gate counts may differ by the constant gate, which kmin_circuit keeps even if unused
+		if (A.size() != B.size() || A.depth() != B.depth()) wrong = true;
+		const int words(4);
+		std::vector<uint64_t> input(A.fanin() * words);
+		for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+		if (A.eval_batch(input) != B.eval_batch(input)) wrong = true;
+	}
+	{
+		const int n(1000), l(64);
+		auto t0 = std::chrono::steady_clock::now();
+		compiled_circuit B(build_kmin(n, l));
+		auto t1 = std::chrono::steady_clock::now();
+		std::cout << "kmin(" << n << ", " << l << "): netlist_builder " << std::chrono::duration<double>(t1 - t0).count()
+			<< " s, " << B.gate_count() << " gates" << std::endl;
+		t0 = std::chrono::steady_clock::now();
+		kmin_circuit C(n, l);
+		t1 = std::chrono::steady_clock::now();
+		std::cout << "kmin(" << n << ", " << l << "): kmin_circuit " << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+	}
+	if (wrong) std::cout << "test_netlist_builder: wrong." << std::endl;
+	else std::cout << "test_netlist_builder: passed." << std::endl;
+}
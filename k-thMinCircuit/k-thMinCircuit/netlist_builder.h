@@ -0,0 +1,106 @@
+#pragma once
+#include "circuit.h"
+#include "compiled_circuit.h"
+
+#include <vector>
+
+/*
+* Build a netlist directly, without gate objects.
+*
+* A wire is an int handle; every call appends one gate and returns its handle, so the gates come in topological order
+* by construction. Modules are plain functions taking and returning handles (see build_bitadder etc. below):
+* there are no placeholder INPUT gates to splice out, so composing them costs nothing.
+*
+* Constants are folded as the gates are appended (as propagate_constants would do), and build() drops the gates
+* the outputs do not depend on, then sorts by level: the whole construction is linear in the number of gates.
+*/
+class netlist_builder {
+public:
+	/*
+	* A new input wire. Inputs may be created at any time; they are numbered in order of creation.
+	*/
+	int input();
+
+	/*
+	* The wire of constant value v.
+	*/
+	int constant(bool v);
+
+	/*
+	* Append a gate (the wires beyond the arity of the type are ignored, e.g. b for NOT).
+	*/
+	int add(gate::gate_type type, int a, int b = -1, int c = -1);
+
+	int op_not(int a);
+	int op_and(int a, int b);
+	int op_or(int a, int b);
+	int op_xor(int a, int b);
+	int op_nand(int a, int b);
+	int op_nor(int a, int b);
+	int op_xnor(int a, int b);
+	int op_andn(int a, int b);
+	int op_mux(int s, int a, int b);
+	int op_maj(int a, int b, int c);
+
+	/*
+	* Mark w as the next output.
+	*/
+	void output(int w);
+
+	/*
+	* Number of gates appended so far, including inputs and constants.
+	*/
+	int size() const;
+
+	/*
+	* The netlist, levelized; the builder is left empty.
+	*/
+	compiled_circuit build();
+
+private:
+	bool is_const(int w) const;
+	int negate(int a);
+	int fold_extended(gate::gate_type t, int a, int b, int c);
+
+	std::vector<unsigned char> type;
+	std::vector<int> in0, in1, in2, level, out;
+	int nin = 0;
+	int constants[2] = { -1, -1 };
+};
+
+/*
+* The modules of this project, on a netlist_builder. They build the same gates as the circuit classes of the same name.
+*/
+
+/*
+* Full adder: { sum, carry }.
+*/
+std::vector<int> build_adder(netlist_builder& B, int a, int b, int c);
+
+/*
+* See bitadder_circuit: the sum of the bits, small endian.
+*/
+std::vector<int> build_bitadder(netlist_builder& B, const std::vector<int>& bits);
+
+/*
+* See int_adder: a + b, big endian, the overflow is dropped.
+*/
+std::vector<int> build_int_adder(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b);
+
+/*
+* See less_circuit: a < b, big endian.
+*/
+int build_less(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b);
+
+/*
+* See selector: s ? b : a.
+*/
+std::vector<int> build_selector(netlist_builder& B, const std::vector<int>& a, const std::vector<int>& b, int s);
+
+/*
+* The same netlist as compiled_circuit(kmin_circuit(n, l)), with the default kmin_options, up to the order of gates
+* (and an unused constant gate).
+*/
+compiled_circuit build_kmin(int n, int l);
+
+void test_netlist_builder();
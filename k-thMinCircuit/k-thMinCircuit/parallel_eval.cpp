@@ -0,0 +1,149 @@
+#include "parallel_eval.h"
+#include "kmin_circuit.h"
+#include "kmin_reference.h"
+
+#include <chrono>
+
+thread_pool::thread_pool(int threads) {
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i(1); i != threads; ++i) {
+		this->threads.emplace_back(&thread_pool::work, this, i);
+	}
+}
+
+thread_pool::~thread_pool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto& t : threads) t.join();
+}
+
+void thread_pool::run(int tasks, const std::function<void(int, int)>& f) {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		job = &f;
+		this->tasks = tasks;
+		next = 0;
+		busy = threads.size();
+		error = nullptr;
+		++generation;
+	}
+	wake.notify_all();
+	work_on(f, tasks, 0);
+	std::unique_lock<std::mutex> lock(mtx);
+	done.wait(lock, [this] { return busy == 0; });
+	job = nullptr;
+	if (error) std::rethrow_exception(error);
+}
+
+int thread_pool::size() const {
+	return threads.size() + 1;
+}
+
+void thread_pool::work(int worker) {
+	long long seen(0);
+	while (true) {
+		const std::function<void(int, int)>* f;
+		int tasks;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			wake.wait(lock, [&] { return stop || generation != seen; });
+			if (stop) return;
+			seen = generation;
+			f = job;
+			tasks = this->tasks;
+		}
+		work_on(*f, tasks, worker);
+		std::lock_guard<std::mutex> lock(mtx);
+		if (--busy == 0) done.notify_all();
+	}
+}
+
+void thread_pool::work_on(const std::function<void(int, int)>& f, int tasks, int worker) {
+	for (int t; (t = next++) < tasks; ) {
+		try {
+			f(t, worker);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mtx);
+			if (!error) error = std::current_exception();
+			next = tasks; // skip the rest; the first error is rethrown by run
+		}
+	}
+}
+
+parallel_evaluator::parallel_evaluator(const compiled_circuit& C, int threads)
+	: C(C), level(detect_simd()), pool(threads), scratch(pool.size())
+{
+	chunk_words = 4 * simd_words(level);
+}
+
+void parallel_evaluator::eval_batch(const uint64_t* input, uint64_t* output, int words) {
+	int chunks = (words + chunk_words - 1) / chunk_words;
+	pool.run(chunks, [&](int task, int worker) {
+		int begin(task * chunk_words), end(std::min(words, begin + chunk_words));
+		simd_eval(C, input, output, words, begin, end, level, scratch[worker]);
+	});
+}
+
+std::vector<uint64_t> parallel_evaluator::eval_batch(const std::vector<uint64_t>& input) {
+	if (C.fanin() == 0 || input.empty() || input.size() % C.fanin()) return {}; // invalid input.
+	int words = input.size() / C.fanin();
+	std::vector<uint64_t> ret(C.fanout() * words);
+	eval_batch(input.data(), ret.data(), words);
+	return ret;
+}
+
+int parallel_evaluator::threads() const {
+	return pool.size();
+}
+
+void test_parallel_eval() {
+	const int n(100), l(128), words(256); // 16384 vectors
+	int logn(_count_bits(n));
+	kmin_circuit C(n, l);
+	compiled_circuit CC(C);
+	std::vector<uint64_t> input(CC.fanin() * words, 0);
+	for (int i(0); i != n * l; ++i) {
+		for (int w(0); w != words; ++w) {
+			input[i * words + w] = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+		}
+	}
+	std::vector<int> ik(words * 64);
+	for (int lane(0); lane != words * 64; ++lane) {
+		ik[lane] = rand() % n + 1;
+		for (int i(0); i != logn; ++i) {
+			if ((ik[lane] >> (logn - i - 1)) & 1) input[(n * l + i) * words + lane / 64] |= uint64_t(1) << (lane % 64);
+		}
+	}
+
+	int hw = std::max(1u, std::thread::hardware_concurrency());
+	bool wrong(false);
+	for (int threads(1); threads <= hw; threads *= 2) {
+		parallel_evaluator E(CC, threads);
+		std::vector<uint64_t> output(CC.fanout() * words);
+		std::vector<char> ok(words * 64, 0);
+		auto t0 = std::chrono::steady_clock::now();
+		E.eval_batch(input.data(), output.data(), words);
+		auto t1 = std::chrono::steady_clock::now();
+		// validate against the software kmin (bit-sliced), over a pool of the same size
+		thread_pool pool(threads);
+		pool.run(words * 64, [&](int lane, int) {
+			int w(lane / 64), b(lane % 64);
+			bitsliced_kmin B(n, l);
+			B.load_lane(input.data(), words, lane);
+			auto ans = B.kmin(ik[lane]);
+			ok[lane] = 1;
+			for (int j(0); j != l; ++j) {
+				if (((output[j * words + w] >> b) & 1) != ans[j]) ok[lane] = 0;
+			}
+		});
+		auto t2 = std::chrono::steady_clock::now();
+		for (char c : ok) if (!c) wrong = true;
+		std::cout << threads << " thread(s): eval " << words * 64 / std::chrono::duration<double>(t1 - t0).count()
+			<< " vectors/s, validation " << words * 64 / std::chrono::duration<double>(t2 - t1).count() << " vectors/s" << std::endl;
+	}
+	if (wrong) std::cout << "test_parallel_eval: wrong." << std::endl;
+	else std::cout << "test_parallel_eval: passed." << std::endl;
+}
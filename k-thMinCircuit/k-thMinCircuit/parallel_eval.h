@@ -0,0 +1,81 @@
+#pragma once
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+/*
+* A fixed set of worker threads.
+* run(tasks, f) calls f(task, worker) for every task in [0, tasks), spread over the workers, and waits for all of them.
+* worker is in [0, size()), so f can keep per-worker state (e.g. a scratch buffer) indexed by it.
+* The calling thread works as worker 0, so a pool of size 1 starts no thread at all.
+* If f throws, the remaining tasks are skipped and the first exception is rethrown by run.
+*/
+class thread_pool {
+public:
+	/*
+	* threads = 0 means one per hardware thread.
+	*/
+	explicit thread_pool(int threads = 0);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	void run(int tasks, const std::function<void(int, int)>& f);
+
+	int size() const;
+
+private:
+	void work(int worker);
+	void work_on(const std::function<void(int, int)>& f, int tasks, int worker);
+
+	std::vector<std::thread> threads;
+	std::mutex mtx;
+	std::condition_variable wake, done;
+	const std::function<void(int, int)>* job = nullptr;
+	int tasks = 0;
+	std::atomic<int> next{ 0 };
+	int busy = 0;
+	long long generation = 0;
+	bool stop = false;
+	std::exception_ptr error;
+};
+
+/*
+* Evaluate big lane-packed batches (see compiled_circuit::eval_batch) of one compiled circuit over a thread pool.
+* The netlist is shared read-only; each worker has its own value buffer.
+* The batch is cut into chunks of consecutive words, so the output is in the same order as the input.
+*/
+class parallel_evaluator {
+public:
+	/*
+	* C must outlive the evaluator.
+	*/
+	parallel_evaluator(const compiled_circuit& C, int threads = 0);
+
+	void eval_batch(const uint64_t* input, uint64_t* output, int words);
+
+	std::vector<uint64_t> eval_batch(const std::vector<uint64_t>& input);
+
+	int threads() const;
+
+	/*
+	* The number of words a worker takes at a time; a multiple of the SIMD block.
+	*/
+	int chunk_words;
+
+private:
+	const compiled_circuit& C;
+	simd_level level;
+	thread_pool pool;
+	std::vector<std::vector<uint64_t>> scratch;
+};
+
+void test_parallel_eval();
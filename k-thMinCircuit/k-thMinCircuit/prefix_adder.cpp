@@ -0,0 +1,164 @@
+#include "prefix_adder.h"
+#include "int_adder.h"
+#include "compiled_circuit.h"
+#include "kmin_circuit.h"
+
+const char* topology_name(prefix_topology t) {
+	switch (t) {
+	case KOGGE_STONE:
+		return "Kogge-Stone";
+	case BRENT_KUNG:
+		return "Brent-Kung";
+	case SKLANSKY:
+		return "Sklansky";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+* Build the sum bits of a + b in C, where a, b are the first and second n inputs of C (big-endian).
+* sum[p] is the bit of weight 2^p (small endian!); if extend, sum[n] is the carry out.
+*/
+static std::vector<gate*> _prefix_add(circuit& C, int n, prefix_topology t, bool extend) {
+	// bit p lives at in[n - 1 - p] and in[2n - 1 - p]
+	std::vector<gate*> g(n), p(n);
+	for (int i(0); i != n; ++i) {
+		gate* a(C.in[n - 1 - i]), * b(C.in[2 * n - 1 - i]);
+		g[i] = C.new_gate(gate::AND);
+		g[i]->concat(a, b);
+		p[i] = C.new_gate(gate::XOR);
+		p[i]->concat(a, b);
+	}
+	// G[i], P[i] is the group ending at bit i; after the network, the group is [0, i].
+	// Only m positions are needed: the carry into bit i is G[i - 1].
+	int m(extend ? n : n - 1);
+	std::vector<gate*> G(g.begin(), g.begin() + m), P(p.begin(), p.begin() + m);
+	// G[i] = G[i] o G[j]; the new P is left to remove_void if it turns out unused.
+	auto combine = [&](int i, int j) {
+		gate* gand(C.new_gate(gate::AND)), * gor(C.new_gate(gate::OR)), * pand(C.new_gate(gate::AND));
+		gand->concat(P[i], G[j]);
+		gor->concat(G[i], gand);
+		pand->concat(P[i], P[j]);
+		G[i] = gor;
+		P[i] = pand;
+	};
+	switch (t) {
+	case KOGGE_STONE:
+		for (int d(1); d < m; d <<= 1) {
+			// downwards, so that G[i - d] is still of the previous level
+			for (int i(m - 1); i >= d; --i) combine(i, i - d);
+		}
+		break;
+	case BRENT_KUNG: {
+		int d(1);
+		for (; d < m; d <<= 1) {
+			for (int i(2 * d - 1); i < m; i += 2 * d) combine(i, i - d);
+		}
+		for (d >>= 1; d >= 1; d >>= 1) {
+			for (int i(3 * d - 1); i < m; i += 2 * d) combine(i, i - d);
+		}
+		break;
+	}
+	case SKLANSKY:
+		for (int d(1); d < m; d <<= 1) {
+			for (int i(0); i != m; ++i) {
+				if (i & d) combine(i, (i & ~(2 * d - 1)) + d - 1);
+			}
+		}
+		break;
+	default:
+		throw "Unknown prefix topology.";
+	}
+	std::vector<gate*> sum(extend ? n + 1 : n);
+	sum[0] = p[0];
+	for (int i(1); i != n; ++i) {
+		gate* gxor(C.new_gate(gate::XOR));
+		gxor->concat(p[i], G[i - 1]);
+		sum[i] = gxor;
+	}
+	if (extend) sum[n] = G[n - 1];
+	return sum;
+}
+
+prefix_int_adder::prefix_int_adder(int n, prefix_topology t)
+	: circuit(2 * n, n)
+{
+	auto sum = _prefix_add(*this, n, t, false);
+	for (int i(0); i != n; ++i) out[n - 1 - i] = sum[i];
+	remove_void();
+}
+
+prefix_exint_adder::prefix_exint_adder(int n, prefix_topology t)
+	: circuit(2 * n, n + 1)
+{
+	auto sum = _prefix_add(*this, n, t, true);
+	for (int i(0); i <= n; ++i) out[n - i] = sum[i];
+	remove_void();
+}
+
+void test_prefix_adder() {
+	bool wrong(false);
+	for (int length(1); length <= 16; ++length) {
+		for (int t(0); t != END_OF_TOPOLOGY; ++t) {
+			prefix_int_adder A(length, prefix_topology(t));
+			prefix_exint_adder B(length, prefix_topology(t));
+			A.check();
+			B.check();
+			for (int _(0); _ != 50; ++_) {
+				int a = rand() % (1 << length), b = rand() % (1 << length);
+				std::vector<bool> input;
+				for (int i(length - 1); i > -1; --i) input.push_back((a >> i) & 1);
+				for (int i(length - 1); i > -1; --i) input.push_back((b >> i) & 1);
+				auto ret = A.eval(input), ext = B.eval(input);
+				int res(0), eres(0);
+				for (int i(0); i != length; ++i) res = res * 2 + ret[i];
+				for (int i(0); i <= length; ++i) eres = eres * 2 + ext[i];
+				if (res != ((a + b) & ((1 << length) - 1)) || eres != a + b) wrong = true;
+			}
+		}
+	}
+	std::cout << "n: int_adder size, depth | prefix_int_adder size, depth per topology" << std::endl;
+	for (int n : { 4, 8, 16, 32, 64, 128 }) {
+		int_adder R(n);
+		std::cout << n << ": " << R.size() << ", " << compiled_circuit(R).depth();
+		for (int t(0); t != END_OF_TOPOLOGY; ++t) {
+			prefix_int_adder A(n, prefix_topology(t));
+			std::cout << " | " << topology_name(prefix_topology(t)) << " " << A.size() << ", " << compiled_circuit(A).depth();
+		}
+		std::cout << std::endl;
+	}
+	{
+		// the adders of kmin_circuit are only logn bits wide, where a prefix adder does not help:
+		// it is deeper than the ripple adder of MAJ carries, and kmin_circuit gets deeper with it
+		const int n(100), l(32);
+		int logn(_count_bits(n));
+		kmin_circuit R(n, l);
+		std::cout << "kmin_circuit(" << n << ", " << l << "): ripple size " << R.size() << ", depth " << compiled_circuit(R).depth();
+		for (int t(0); t != END_OF_TOPOLOGY; ++t) {
+			kmin_options opt;
+			opt.adder = kmin_options::PREFIX_ADDER;
+			opt.topology = prefix_topology(t);
+			kmin_circuit C(n, l, opt);
+			C.check();
+			std::cout << " | " << topology_name(opt.topology) << " " << C.size() << ", " << compiled_circuit(C).depth();
+			std::vector<bool> val[n];
+			for (int _(0); _ != 50; ++_) {
+				std::vector<bool> input;
+				for (int i(0); i != n; ++i) {
+					val[i].clear();
+					for (int j(0); j != l; ++j) {
+						val[i].push_back(rand() % 2);
+						input.push_back(val[i].back());
+					}
+				}
+				int ik = rand() % n + 1;
+				for (int i(0); i != logn; ++i) input.push_back((ik >> (logn - i - 1)) & 1);
+				if (C.eval(input) != kmin(val, n, ik)) wrong = true;
+			}
+		}
+		std::cout << std::endl;
+	}
+	if (wrong) std::cout << "test_prefix_adder: wrong." << std::endl;
+	else std::cout << "test_prefix_adder: passed." << std::endl;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "circuit.h"
+
+/*
+* The carry network of a parallel-prefix adder.
+* 
+* Each bit position i has a (generate, propagate) pair (a_i AND b_i, a_i XOR b_i); the carry into bit i is the
+* generate signal of the group [0, i), obtained by combining the pairs with the associative operator
+*     (G, P) o (G', P') = (G OR (P AND G'), P AND P')    ((G, P) being the more significant group)
+* A topology is the order in which the groups are combined. For m prefix positions:
+* 
+*     KOGGE_STONE: log m levels, m log m operators, fan-out 2.       Shortest and largest.
+*     BRENT_KUNG:  2 log m - 1 levels, about 2m operators, fan-out 2. Smallest, yet still logarithmic.
+*     SKLANSKY:    log m levels, (m / 2) log m operators, but the fan-out doubles at every level.
+* 
+* Every operator is 3 gates (2 when its P is not needed), and a level of operators is 2 gates deep.
+*/
+enum prefix_topology { KOGGE_STONE, BRENT_KUNG, SKLANSKY, END_OF_TOPOLOGY };
+
+const char* topology_name(prefix_topology t);
+
+/*
+* The same as int_adder: add two n-bit integers, big-endian, the overflow is dropped;
+* but the carries are computed by a prefix network, so the depth is O(log n) instead of O(n).
+*/
+class prefix_int_adder :
+    public circuit
+{
+public:
+    prefix_int_adder(int n, prefix_topology t = KOGGE_STONE);
+};
+
+/*
+* The same as exint_adder: add two n-bit integers, result an (n+1)-bit integer, big-endian;
+* but the carries are computed by a prefix network.
+*/
+class prefix_exint_adder :
+    public circuit
+{
+public:
+    prefix_exint_adder(int n, prefix_topology t = KOGGE_STONE);
+};
+
+void test_prefix_adder();
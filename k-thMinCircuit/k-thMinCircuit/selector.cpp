@@ -3,16 +3,10 @@
 selector::selector(int n)
 	: circuit(2 * n + 1, n)
 {
-	gate* gnot = new gate(gate::NOT);
-	gnot->concat(in[2 * n]);
 	for (int i(0); i != n; ++i) {
-		gate* gand[2];
-		gate::init(gand, 2, gate::AND);
-		gate* gor(new gate(gate::OR));
-		gand[0]->concat(in[i], gnot);
-		gand[1]->concat(in[i + n], in[2 * n]);
-		gor->concat(gand[0], gand[1]);
-		out[i] = gor;
+		gate* gmux(new_gate(gate::MUX));
+		gmux->concat(in[2 * n], in[i], in[i + n]);
+		out[i] = gmux;
 	}
 }
 
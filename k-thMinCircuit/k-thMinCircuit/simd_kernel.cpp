@@ -0,0 +1,467 @@
+#include "simd_kernel.h"
+#include "compiled_circuit.h"
+#include "lut_circuit.h"
+#include "kmin_circuit.h"
+
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KMC_X86
+#include <immintrin.h>
+#endif
+
+/*
+* GCC and clang only let us use the intrinsics in functions compiled for the corresponding target;
+* MSVC does not need that.
+*/
+#if defined(__GNUC__)
+#define KMC_TARGET(isa) __attribute__((target(isa)))
+#define KMC_INLINE inline __attribute__((always_inline))
+#else
+#define KMC_TARGET(isa)
+#define KMC_INLINE __forceinline
+#endif
+
+/*
+* Each backend provides the gate operations over a block of "words" uint64_t.
+* They work on memory only, so no vector type shows up in a signature outside of its target.
+* op_lut3 is the 3-input function of truth table imm, with a, b, c as bits 2, 1, 0 of the index (as in vpternlogq);
+* without ternary logic it is computed as multiplexers: on c between the bits of imm, then on b, then on a.
+*/
+struct scalar_ops {
+	static const int words = 1;
+	static void copy(uint64_t* d, const uint64_t* a) { *d = *a; }
+	static void fill(uint64_t* d, bool v) { *d = v ? ~uint64_t(0) : 0; }
+	static void op_not(uint64_t* d, const uint64_t* a) { *d = ~*a; }
+	static void op_and(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = *a & *b; }
+	static void op_or(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = *a | *b; }
+	static void op_xor(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = *a ^ *b; }
+	static void op_nand(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = ~(*a & *b); }
+	static void op_nor(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = ~(*a | *b); }
+	static void op_xnor(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = ~(*a ^ *b); }
+	static void op_andn(uint64_t* d, const uint64_t* a, const uint64_t* b) { *d = *a & ~*b; }
+	static void op_mux(uint64_t* d, const uint64_t* s, const uint64_t* a, const uint64_t* b) { *d = (*s & *b) | (~*s & *a); }
+	static void op_maj(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c) { *d = (*a & *b) | (*c & (*a | *b)); }
+	static void op_lut3(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c, unsigned char imm) {
+		uint64_t m[8];
+		for (int i(0); i != 8; ++i) m[i] = uint64_t(0) - ((imm >> i) & 1);
+		uint64_t v[4];
+		for (int i(0); i != 4; ++i) v[i] = m[2 * i] ^ ((m[2 * i] ^ m[2 * i + 1]) & *c);
+		uint64_t lo(v[0] ^ ((v[0] ^ v[1]) & *b)), hi(v[2] ^ ((v[2] ^ v[3]) & *b));
+		*d = lo ^ ((lo ^ hi) & *a);
+	}
+};
+
+#ifdef KMC_X86
+struct sse2_ops {
+	static const int words = 2;
+#define KMC_LD(p) _mm_loadu_si128((const __m128i*)(p))
+#define KMC_ST(p, v) _mm_storeu_si128((__m128i*)(p), v)
+	KMC_TARGET("sse2") static void copy(uint64_t* d, const uint64_t* a) { KMC_ST(d, KMC_LD(a)); }
+	KMC_TARGET("sse2") static void fill(uint64_t* d, bool v) { KMC_ST(d, _mm_set1_epi32(v ? -1 : 0)); }
+	KMC_TARGET("sse2") static void op_not(uint64_t* d, const uint64_t* a) { KMC_ST(d, _mm_xor_si128(KMC_LD(a), _mm_set1_epi32(-1))); }
+	KMC_TARGET("sse2") static void op_and(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_and_si128(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("sse2") static void op_or(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_or_si128(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("sse2") static void op_xor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_xor_si128(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("sse2") static void op_nand(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_xor_si128(_mm_and_si128(KMC_LD(a), KMC_LD(b)), _mm_set1_epi32(-1))); }
+	KMC_TARGET("sse2") static void op_nor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_xor_si128(_mm_or_si128(KMC_LD(a), KMC_LD(b)), _mm_set1_epi32(-1))); }
+	KMC_TARGET("sse2") static void op_xnor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_xor_si128(_mm_xor_si128(KMC_LD(a), KMC_LD(b)), _mm_set1_epi32(-1))); }
+	KMC_TARGET("sse2") static void op_andn(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm_andnot_si128(KMC_LD(b), KMC_LD(a))); }
+	KMC_TARGET("sse2") static void op_mux(uint64_t* d, const uint64_t* s, const uint64_t* a, const uint64_t* b) {
+		__m128i m(KMC_LD(s));
+		KMC_ST(d, _mm_or_si128(_mm_and_si128(m, KMC_LD(b)), _mm_andnot_si128(m, KMC_LD(a))));
+	}
+	KMC_TARGET("sse2") static void op_maj(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c) {
+		__m128i x(KMC_LD(a)), y(KMC_LD(b));
+		KMC_ST(d, _mm_or_si128(_mm_and_si128(x, y), _mm_and_si128(KMC_LD(c), _mm_or_si128(x, y))));
+	}
+	KMC_TARGET("sse2") static void op_lut3(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c, unsigned char imm) {
+		__m128i x(KMC_LD(a)), y(KMC_LD(b)), z(KMC_LD(c)), v[4];
+		for (int i(0); i != 4; ++i) {
+			__m128i m0(_mm_set1_epi32(-((imm >> (2 * i)) & 1))), m1(_mm_set1_epi32(-((imm >> (2 * i + 1)) & 1)));
+			v[i] = _mm_xor_si128(m0, _mm_and_si128(_mm_xor_si128(m0, m1), z));
+		}
+		__m128i lo(_mm_xor_si128(v[0], _mm_and_si128(_mm_xor_si128(v[0], v[1]), y)));
+		__m128i hi(_mm_xor_si128(v[2], _mm_and_si128(_mm_xor_si128(v[2], v[3]), y)));
+		KMC_ST(d, _mm_xor_si128(lo, _mm_and_si128(_mm_xor_si128(lo, hi), x)));
+	}
+#undef KMC_LD
+#undef KMC_ST
+};
+
+struct avx2_ops {
+	static const int words = 4;
+#define KMC_LD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define KMC_ST(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+	KMC_TARGET("avx2") static void copy(uint64_t* d, const uint64_t* a) { KMC_ST(d, KMC_LD(a)); }
+	KMC_TARGET("avx2") static void fill(uint64_t* d, bool v) { KMC_ST(d, _mm256_set1_epi32(v ? -1 : 0)); }
+	KMC_TARGET("avx2") static void op_not(uint64_t* d, const uint64_t* a) { KMC_ST(d, _mm256_xor_si256(KMC_LD(a), _mm256_set1_epi32(-1))); }
+	KMC_TARGET("avx2") static void op_and(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_and_si256(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("avx2") static void op_or(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_or_si256(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("avx2") static void op_xor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_xor_si256(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("avx2") static void op_nand(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_xor_si256(_mm256_and_si256(KMC_LD(a), KMC_LD(b)), _mm256_set1_epi32(-1))); }
+	KMC_TARGET("avx2") static void op_nor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_xor_si256(_mm256_or_si256(KMC_LD(a), KMC_LD(b)), _mm256_set1_epi32(-1))); }
+	KMC_TARGET("avx2") static void op_xnor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_xor_si256(_mm256_xor_si256(KMC_LD(a), KMC_LD(b)), _mm256_set1_epi32(-1))); }
+	KMC_TARGET("avx2") static void op_andn(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm256_andnot_si256(KMC_LD(b), KMC_LD(a))); }
+	KMC_TARGET("avx2") static void op_mux(uint64_t* d, const uint64_t* s, const uint64_t* a, const uint64_t* b) {
+		__m256i m(KMC_LD(s));
+		KMC_ST(d, _mm256_or_si256(_mm256_and_si256(m, KMC_LD(b)), _mm256_andnot_si256(m, KMC_LD(a))));
+	}
+	KMC_TARGET("avx2") static void op_maj(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c) {
+		__m256i x(KMC_LD(a)), y(KMC_LD(b));
+		KMC_ST(d, _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(KMC_LD(c), _mm256_or_si256(x, y))));
+	}
+	KMC_TARGET("avx2") static void op_lut3(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c, unsigned char imm) {
+		__m256i x(KMC_LD(a)), y(KMC_LD(b)), z(KMC_LD(c)), v[4];
+		for (int i(0); i != 4; ++i) {
+			__m256i m0(_mm256_set1_epi32(-((imm >> (2 * i)) & 1))), m1(_mm256_set1_epi32(-((imm >> (2 * i + 1)) & 1)));
+			v[i] = _mm256_xor_si256(m0, _mm256_and_si256(_mm256_xor_si256(m0, m1), z));
+		}
+		__m256i lo(_mm256_xor_si256(v[0], _mm256_and_si256(_mm256_xor_si256(v[0], v[1]), y)));
+		__m256i hi(_mm256_xor_si256(v[2], _mm256_and_si256(_mm256_xor_si256(v[2], v[3]), y)));
+		KMC_ST(d, _mm256_xor_si256(lo, _mm256_and_si256(_mm256_xor_si256(lo, hi), x)));
+	}
+#undef KMC_LD
+#undef KMC_ST
+};
+
+struct avx512_ops {
+	static const int words = 8;
+#define KMC_LD(p) _mm512_loadu_si512((const void*)(p))
+#define KMC_ST(p, v) _mm512_storeu_si512((void*)(p), v)
+	KMC_TARGET("avx512f") static void copy(uint64_t* d, const uint64_t* a) { KMC_ST(d, KMC_LD(a)); }
+	KMC_TARGET("avx512f") static void fill(uint64_t* d, bool v) { KMC_ST(d, _mm512_set1_epi32(v ? -1 : 0)); }
+	KMC_TARGET("avx512f") static void op_not(uint64_t* d, const uint64_t* a) { KMC_ST(d, _mm512_xor_si512(KMC_LD(a), _mm512_set1_epi32(-1))); }
+	KMC_TARGET("avx512f") static void op_and(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm512_and_si512(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("avx512f") static void op_or(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm512_or_si512(KMC_LD(a), KMC_LD(b))); }
+	KMC_TARGET("avx512f") static void op_xor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm512_xor_si512(KMC_LD(a), KMC_LD(b))); }
+	// vpternlog computes any function of three operands; imm is its truth table, with A = 0xf0, B = 0xcc, C = 0xaa.
+#define KMC_TERN(d, a, b, c, imm) KMC_ST(d, _mm512_ternarylogic_epi64(KMC_LD(a), KMC_LD(b), KMC_LD(c), imm))
+	KMC_TARGET("avx512f") static void op_nand(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_TERN(d, a, b, b, 0x3f); }
+	KMC_TARGET("avx512f") static void op_nor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_TERN(d, a, b, b, 0x03); }
+	KMC_TARGET("avx512f") static void op_xnor(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_TERN(d, a, b, b, 0xc3); }
+	KMC_TARGET("avx512f") static void op_andn(uint64_t* d, const uint64_t* a, const uint64_t* b) { KMC_ST(d, _mm512_andnot_si512(KMC_LD(b), KMC_LD(a))); }
+	KMC_TARGET("avx512f") static void op_mux(uint64_t* d, const uint64_t* s, const uint64_t* a, const uint64_t* b) { KMC_TERN(d, s, a, b, 0xac); }
+	KMC_TARGET("avx512f") static void op_maj(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c) { KMC_TERN(d, a, b, c, 0xe8); }
+	// the immediate must be a constant: one case per truth table.
+	KMC_TARGET("avx512f") static void op_lut3(uint64_t* d, const uint64_t* a, const uint64_t* b, const uint64_t* c, unsigned char imm) {
+		switch (imm) {
+#define KMC_CASE(i) case i: KMC_TERN(d, a, b, c, i); break;
+#define KMC_CASE4(i) KMC_CASE(i) KMC_CASE(i + 1) KMC_CASE(i + 2) KMC_CASE(i + 3)
+#define KMC_CASE16(i) KMC_CASE4(i) KMC_CASE4(i + 4) KMC_CASE4(i + 8) KMC_CASE4(i + 12)
+#define KMC_CASE64(i) KMC_CASE16(i) KMC_CASE16(i + 16) KMC_CASE16(i + 32) KMC_CASE16(i + 48)
+		KMC_CASE64(0) KMC_CASE64(64) KMC_CASE64(128) KMC_CASE64(192)
+#undef KMC_CASE64
+#undef KMC_CASE16
+#undef KMC_CASE4
+#undef KMC_CASE
+		}
+	}
+#undef KMC_TERN
+#undef KMC_LD
+#undef KMC_ST
+};
+#endif
+
+/*
+* Evaluate words [begin, end) of the batch, one block of ops::words words at a time.
+* val is the scratch buffer, one block per gate.
+*/
+template <class ops>
+KMC_INLINE static void _sweep(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	const int W(ops::words), nin(C.fanin()), ngate(C.gate_count()), nout(C.fanout());
+	const unsigned char* type(C.type.data());
+	const int* in0(C.in0.data()), * in1(C.in1.data()), * in2(C.in2.data()), * out(C.out.data());
+	for (int w(begin); w + W <= end; w += W) {
+		int i(0);
+		for (; i != nin; ++i) ops::copy(val + i * W, input + i * words + w);
+		for (; i != ngate; ++i) {
+			switch (type[i]) {
+			case gate::NOT:
+				ops::op_not(val + i * W, val + in0[i] * W);
+				break;
+			case gate::AND:
+				ops::op_and(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::OR:
+				ops::op_or(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::XOR:
+				ops::op_xor(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::NAND:
+				ops::op_nand(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::NOR:
+				ops::op_nor(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::XNOR:
+				ops::op_xnor(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::ANDN:
+				ops::op_andn(val + i * W, val + in0[i] * W, val + in1[i] * W);
+				break;
+			case gate::MUX:
+				ops::op_mux(val + i * W, val + in0[i] * W, val + in1[i] * W, val + in2[i] * W);
+				break;
+			case gate::MAJ:
+				ops::op_maj(val + i * W, val + in0[i] * W, val + in1[i] * W, val + in2[i] * W);
+				break;
+			case gate::ZERO:
+				ops::fill(val + i * W, false);
+				break;
+			case gate::ONE:
+				ops::fill(val + i * W, true);
+				break;
+			default:
+				throw "Ill-formed compiled circuit.";
+			}
+		}
+		for (int j(0); j != nout; ++j) ops::copy(output + j * words + w, val + out[j] * W);
+	}
+}
+
+/*
+* The same for the program of a lut_circuit: one op_lut3 per instruction.
+*/
+template <class ops>
+KMC_INLINE static void _sweep_lut(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	const int W(ops::words), nin(L.fanin()), nop(L.op_imm.size()), nout(L.fanout());
+	const unsigned char* imm(L.op_imm.data());
+	const int* a(L.op_a.data()), * b(L.op_b.data()), * c(L.op_c.data()), * out(L.out_slot.data());
+	uint64_t* dst(val + nin * W);
+	for (int w(begin); w + W <= end; w += W) {
+		for (int i(0); i != nin; ++i) ops::copy(val + i * W, input + i * words + w);
+		for (int i(0); i != nop; ++i) ops::op_lut3(dst + i * W, val + a[i] * W, val + b[i] * W, val + c[i] * W, imm[i]);
+		for (int j(0); j != nout; ++j) ops::copy(output + j * words + w, val + out[j] * W);
+	}
+}
+
+static void _sweep_scalar(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep<scalar_ops>(C, input, output, words, begin, end, val);
+}
+
+#ifdef KMC_X86
+KMC_TARGET("sse2") static void _sweep_sse2(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep<sse2_ops>(C, input, output, words, begin, end, val);
+}
+
+KMC_TARGET("avx2") static void _sweep_avx2(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep<avx2_ops>(C, input, output, words, begin, end, val);
+}
+
+KMC_TARGET("avx512f") static void _sweep_avx512(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep<avx512_ops>(C, input, output, words, begin, end, val);
+}
+#endif
+
+static void _sweep_scalar(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep_lut<scalar_ops>(L, input, output, words, begin, end, val);
+}
+
+#ifdef KMC_X86
+KMC_TARGET("sse2") static void _sweep_sse2(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep_lut<sse2_ops>(L, input, output, words, begin, end, val);
+}
+
+KMC_TARGET("avx2") static void _sweep_avx2(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep_lut<avx2_ops>(L, input, output, words, begin, end, val);
+}
+
+KMC_TARGET("avx512f") static void _sweep_avx512(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, int begin, int end, uint64_t* val) {
+	_sweep_lut<avx512_ops>(L, input, output, words, begin, end, val);
+}
+#endif
+
+static simd_level _detect_simd() {
+#if defined(KMC_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#elif defined(KMC_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int nid = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] >> 26) & 1;
+	bool osxsave = (info[2] >> 27) & 1;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6, zmm = (xcr0 & 0xe6) == 0xe6;
+	if (nid >= 7) {
+		__cpuidex(info, 7, 0);
+		if (zmm && ((info[1] >> 16) & 1)) return SIMD_AVX512;
+		if (ymm && ((info[1] >> 5) & 1)) return SIMD_AVX2;
+	}
+	if (sse2) return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+simd_level detect_simd() {
+	static const simd_level level = _detect_simd();
+	return level;
+}
+
+std::string simd_name(simd_level level) {
+	switch (level) {
+	case SIMD_SCALAR:
+		return "scalar";
+	case SIMD_SSE2:
+		return "SSE2";
+	case SIMD_AVX2:
+		return "AVX2";
+	case SIMD_AVX512:
+		return "AVX-512";
+	default:
+		throw "Invalid SIMD level.";
+	}
+}
+
+int simd_words(simd_level level) {
+	switch (level) {
+	case SIMD_SCALAR:
+		return 1;
+	case SIMD_SSE2:
+		return 2;
+	case SIMD_AVX2:
+		return 4;
+	case SIMD_AVX512:
+		return 8;
+	default:
+		throw "Invalid SIMD level.";
+	}
+}
+
+void simd_eval(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, simd_level level) {
+	std::vector<uint64_t> scratch;
+	simd_eval(C, input, output, words, 0, words, level, scratch);
+}
+
+void simd_eval(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end,
+	simd_level level, std::vector<uint64_t>& scratch) {
+	if (level < SIMD_SCALAR || level >= END_OF_SIMD) throw "Invalid SIMD level.";
+	if (level > detect_simd()) throw "SIMD level not supported by this CPU.";
+	int W(simd_words(level)), done(begin + (end - begin) / W * W);
+	if (scratch.size() < C.gate_count() * W) scratch.resize(C.gate_count() * W);
+	uint64_t* val(scratch.data());
+	switch (level) {
+#ifdef KMC_X86
+	case SIMD_SSE2:
+		_sweep_sse2(C, input, output, words, begin, done, val);
+		break;
+	case SIMD_AVX2:
+		_sweep_avx2(C, input, output, words, begin, done, val);
+		break;
+	case SIMD_AVX512:
+		_sweep_avx512(C, input, output, words, begin, done, val);
+		break;
+#endif
+	default:
+		done = begin;
+		break;
+	}
+	_sweep_scalar(C, input, output, words, done, end, val);
+}
+
+void simd_eval(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, simd_level level) {
+	if (level < SIMD_SCALAR || level >= END_OF_SIMD) throw "Invalid SIMD level.";
+	if (level > detect_simd()) throw "SIMD level not supported by this CPU.";
+	int W(simd_words(level)), done(words / W * W);
+	std::vector<uint64_t> scratch((L.fanin() + L.op_imm.size()) * W);
+	uint64_t* val(scratch.data());
+	switch (level) {
+#ifdef KMC_X86
+	case SIMD_SSE2:
+		_sweep_sse2(L, input, output, words, 0, done, val);
+		break;
+	case SIMD_AVX2:
+		_sweep_avx2(L, input, output, words, 0, done, val);
+		break;
+	case SIMD_AVX512:
+		_sweep_avx512(L, input, output, words, 0, done, val);
+		break;
+#endif
+	default:
+		done = 0;
+		break;
+	}
+	_sweep_scalar(L, input, output, words, done, words, val);
+}
+
+/*
+* One gate of every type on the inputs (a, b, c), in the order of the arity; output t is the gate of type t.
+*/
+class _all_gates :
+	public circuit
+{
+public:
+	_all_gates()
+		: circuit(3, gate::END_OF_TYPE)
+	{
+		for (int t(0); t != gate::END_OF_TYPE; ++t) {
+			gate::gate_type type = gate::gate_type(t);
+			if (type == gate::INPUT) out[t] = in[0];
+			else if (gate::arity(type) == 0) out[t] = constant(type == gate::ONE);
+			else {
+				out[t] = new_gate(type);
+				for (int i(0); i != gate::arity(type); ++i) out[t]->concat(in[i]);
+			}
+		}
+	}
+};
+
+void test_simd_eval() {
+	const int nl[][2] = { {16, 32}, {100, 128}, {256, 64} };
+	const int words(64); // 4096 vectors per batch
+	bool wrong(false);
+	std::cout << "detected: " << simd_name(detect_simd()) << std::endl;
+	{
+		// every gate type on every level, against the truth table of gate::apply; vector j is the input j % 8.
+		_all_gates C;
+		compiled_circuit CC(C);
+		std::vector<uint64_t> input(3 * words);
+		for (int i(0); i != 3; ++i) {
+			for (int j(0); j != 64; ++j) input[i * words] |= uint64_t((j >> (2 - i)) & 1) << j;
+			for (int w(1); w != words; ++w) input[i * words + w] = input[i * words];
+		}
+		for (int level(SIMD_SCALAR); level <= detect_simd(); ++level) {
+			std::vector<uint64_t> output(CC.fanout() * words);
+			simd_eval(CC, input.data(), output.data(), words, simd_level(level));
+			for (int t(0); t != gate::END_OF_TYPE; ++t) {
+				for (int j(0); j != 8; ++j) {
+					bool a((j >> 2) & 1), b((j >> 1) & 1), c(j & 1);
+					bool expected(t == gate::INPUT ? a : gate::apply(gate::gate_type(t), a, b, c));
+					if (((output[t * words + words - 1] >> j) & 1) != expected) wrong = true;
+					if (level == SIMD_SCALAR && (C.eval({ a, b, c })[t] != expected || CC.eval({ a, b, c })[t] != expected)) wrong = true;
+				}
+			}
+		}
+	}
+	for (auto p : nl) {
+		int n(p[0]), l(p[1]);
+		kmin_circuit C(n, l);
+		compiled_circuit CC(C);
+		std::vector<uint64_t> input(CC.fanin() * words), ref;
+		for (auto& w : input) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+		for (int level(SIMD_SCALAR); level <= detect_simd(); ++level) {
+			std::vector<uint64_t> output(CC.fanout() * words);
+			auto t0 = std::chrono::steady_clock::now();
+			int rounds(0);
+			do {
+				simd_eval(CC, input.data(), output.data(), words, simd_level(level));
+				++rounds;
+			} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(300));
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			std::cout << "kmin_circuit(" << n << ", " << l << ") " << simd_name(simd_level(level)) << ": "
+				<< rounds * words * 64 / sec << " vectors/s" << std::endl;
+			if (level == SIMD_SCALAR) ref = output;
+			else if (output != ref) wrong = true;
+		}
+	}
+	if (wrong) std::cout << "test_simd_eval: wrong." << std::endl;
+	else std::cout << "test_simd_eval: passed." << std::endl;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class compiled_circuit;
+class lut_circuit;
+
+/*
+* The instruction set used by compiled_circuit::eval_batch.
+* A gate is evaluated over simd_words(level) * 64 input vectors per instruction.
+*/
+enum simd_level {
+	SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512, END_OF_SIMD
+};
+
+/*
+* The best level supported by the CPU we are running on (checked by CPUID once, then cached).
+*/
+simd_level detect_simd();
+
+std::string simd_name(simd_level level);
+
+/*
+* Number of uint64_t words in a register of the given level.
+*/
+int simd_words(simd_level level);
+
+/*
+* Evaluate a lane-packed batch (see compiled_circuit::eval_batch) with the given level,
+* in blocks of simd_words(level) words; the remaining words (less than one block) are done by the scalar kernel.
+* If the CPU does not support the level, it throws.
+*/
+void simd_eval(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, simd_level level);
+
+/*
+* Evaluate only words [begin, end) of the batch; the buffers are still laid out with stride "words".
+* scratch is the value buffer; it is resized as needed, so a caller evaluating many batches can keep it around.
+* Different ranges of the same batch can be evaluated concurrently, as long as each caller has its own scratch.
+*/
+void simd_eval(const compiled_circuit& C, const uint64_t* input, uint64_t* output, int words, int begin, int end,
+	simd_level level, std::vector<uint64_t>& scratch);
+
+/*
+* Run the program of a lut_circuit (see lut_circuit.h) on a lane-packed batch, the same way.
+*/
+void simd_eval(const lut_circuit& L, const uint64_t* input, uint64_t* output, int words, simd_level level);
+
+void test_simd_eval();
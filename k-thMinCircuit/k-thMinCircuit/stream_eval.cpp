@@ -0,0 +1,392 @@
+#include "stream_eval.h"
+#include "adder_circuit.h"
+#include "bitadder_circuit.h"
+#include "int_adder.h"
+#include "prefix_adder.h"
+#include "compare_circuit.h"
+#include "selector.h"
+#include "kmin_circuit.h"
+#include "netlist_builder.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+
+stream_evaluator::stream_evaluator(const compiled_circuit& C, engine_type engine, int threads, int words)
+	: C(C), engine(engine), words(words)
+{
+	if (C.fanin() == 0) throw "The circuit has no input.";
+	if (words <= 0) throw "The batch should have at least one record.";
+	if (engine == PARALLEL_ENGINE) parallel.reset(new parallel_evaluator(this->C, threads));
+	if (engine == NATIVE_ENGINE) native.reset(new native_circuit(this->C));
+}
+
+int stream_evaluator::fanin() const {
+	return C.fanin();
+}
+
+int stream_evaluator::fanout() const {
+	return C.fanout();
+}
+
+void stream_evaluator::eval_batch(const uint64_t* input, uint64_t* output, int words) {
+	switch (engine) {
+	case PARALLEL_ENGINE:
+		parallel->eval_batch(input, output, words);
+		break;
+	case NATIVE_ENGINE:
+		native->eval_batch(input, output, words);
+		break;
+	default:
+		C.eval_batch(input, output, words);
+		break;
+	}
+}
+
+/*
+* dst[j * r + w] = src[w * m + j] for w < r, j < m: r records of m words to the layout of eval_batch.
+* Done by tiles of 8 records, so both sides are accessed in whole cache lines.
+*/
+static void _transpose(const uint64_t* src, uint64_t* dst, int r, int m) {
+	for (int w0(0); w0 < r; w0 += 8) {
+		int w1(std::min(r, w0 + 8));
+		for (int j(0); j != m; ++j) {
+			for (int w(w0); w != w1; ++w) dst[size_t(j) * r + w] = src[size_t(w) * m + j];
+		}
+	}
+}
+
+/*
+* Read up to count words; fewer only at end of file. It throws if the file ends inside a word.
+*/
+static size_t _read_words(uint64_t* buf, size_t count, FILE* f) {
+	// by bytes, so that a trailing partial word is seen rather than dropped by fread
+	char* p((char*)buf);
+	size_t got(0), want(count * sizeof(uint64_t));
+	while (got != want) {
+		size_t r = fread(p + got, 1, want - got, f);
+		if (r == 0) {
+			if (ferror(f)) throw "Read error.";
+			break;
+		}
+		got += r;
+	}
+	if (got % sizeof(uint64_t)) throw "Incomplete input record.";
+	return got / sizeof(uint64_t);
+}
+
+long long stream_evaluator::run(FILE* input, FILE* output) {
+	// A batch goes FREE -> READ (by the reader) -> EVALUATED (by this thread) -> FREE (by the writer).
+	// A batch of 0 records marks the end of the stream.
+	enum { FREE, READ, EVALUATED };
+	struct batch {
+		std::vector<uint64_t> in, out;
+		int records = 0;
+		int state = FREE;
+	};
+	const int slots(3);
+	int fin(C.fanin()), fout(C.fanout());
+	std::vector<batch> ring(slots);
+	for (batch& b : ring) {
+		b.in.resize(size_t(fin) * words);
+		b.out.resize(size_t(fout) * words);
+	}
+	std::mutex mtx;
+	std::condition_variable cv;
+	const char* error(nullptr);
+	long long total(0);
+	auto wait_for = [&](batch& b, int state) {
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [&] { return b.state == state || error; });
+		return error == nullptr;
+	};
+	auto set = [&](batch& b, int state) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			b.state = state;
+		}
+		cv.notify_all();
+	};
+	auto fail = [&](const char* e) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (!error) error = e;
+		}
+		cv.notify_all();
+	};
+
+	std::thread reader([&] {
+		// records as read, to be transposed into the layout of eval_batch
+		std::vector<uint64_t> raw(size_t(fin) * words);
+		try {
+			for (int i(0); ; ++i) {
+				batch& b(ring[i % slots]);
+				if (!wait_for(b, FREE)) return;
+				size_t got = _read_words(raw.data(), raw.size(), input);
+				if (got % fin) throw "Incomplete input record.";
+				int r = got / fin;
+				_transpose(raw.data(), b.in.data(), r, fin);
+				b.records = r;
+				set(b, READ);
+				if (r == 0) return;
+			}
+		} catch (const char* e) {
+			fail(e);
+		}
+	});
+	std::thread writer([&] {
+		std::vector<uint64_t> raw(size_t(fout) * words);
+		try {
+			for (int i(0); ; ++i) {
+				batch& b(ring[i % slots]);
+				if (!wait_for(b, EVALUATED)) return;
+				int r(b.records);
+				if (r == 0) return;
+				for (int w0(0); w0 < r; w0 += 8) { // back to records, by tiles as well
+					int w1(std::min(r, w0 + 8));
+					for (int j(0); j != fout; ++j) {
+						for (int w(w0); w != w1; ++w) raw[size_t(w) * fout + j] = b.out[size_t(j) * r + w];
+					}
+				}
+				if (fwrite(raw.data(), sizeof(uint64_t), size_t(fout) * r, output) != size_t(fout) * r) throw "Write error.";
+				total += r;
+				set(b, FREE);
+			}
+		} catch (const char* e) {
+			fail(e);
+		}
+	});
+	try {
+		for (int i(0); ; ++i) {
+			batch& b(ring[i % slots]);
+			if (!wait_for(b, READ)) break;
+			int r(b.records); // b belongs to the writer (then the reader) once it is marked
+			if (r) eval_batch(b.in.data(), b.out.data(), r);
+			set(b, EVALUATED);
+			if (r == 0) break;
+		}
+	} catch (const char* e) {
+		fail(e);
+	}
+	reader.join();
+	writer.join();
+	if (error) throw error;
+	if (fflush(output) != 0) throw "Write error.";
+	return total;
+}
+
+/*
+* The command line, as "--key value" pairs after the circuit name (and the file name, for load).
+*/
+struct _cli_args {
+	std::map<std::string, std::string> opt;
+	std::string get(const std::string& key, const std::string& def) const {
+		auto itr = opt.find(key);
+		return itr == opt.end() ? def : itr->second;
+	}
+	int number(const std::string& key, int def) const {
+		auto itr = opt.find(key);
+		if (itr == opt.end()) return def;
+		char* end;
+		long v = strtol(itr->second.c_str(), &end, 10);
+		if (itr->second.empty() || *end || v < 0 || v > (1 << 30)) throw "Invalid number.";
+		return int(v);
+	}
+	int required(const std::string& key) const {
+		if (!opt.count(key)) throw "Missing parameter of the circuit (e.g. --n).";
+		int v(number(key, 0));
+		if (v < 1) throw "Invalid number.";
+		return v;
+	}
+};
+
+static const char* _circuit_names[] = { "load", "adder", "bitadder", "csa_bitadder", "int_adder", "exint_adder",
+	"prefix_adder", "compare", "less", "selector", "kmin" };
+
+static compiled_circuit _generate(const std::string& name, const std::string& file, const _cli_args& A) {
+	if (name == "load") return compiled_circuit::load(file);
+	if (name == "adder") return compiled_circuit(adder_circuit());
+	if (name == "bitadder") return compiled_circuit(bitadder_circuit(A.required("--n")));
+	if (name == "csa_bitadder") return compiled_circuit(csa_bitadder_circuit(A.required("--n")));
+	if (name == "int_adder") return compiled_circuit(int_adder(A.required("--n")));
+	if (name == "exint_adder") return compiled_circuit(exint_adder(A.required("--n")));
+	if (name == "prefix_adder") return compiled_circuit(prefix_int_adder(A.required("--n")));
+	if (name == "compare") return compiled_circuit(compare_circuit(A.required("--n")));
+	if (name == "less") return compiled_circuit(less_circuit(A.required("--n")));
+	if (name == "selector") return compiled_circuit(selector(A.required("--n")));
+	if (name == "kmin") {
+		int n(A.required("--n")), l(A.required("--l"));
+		kmin_options opt;
+		bool plain(true);
+		std::string s;
+		if ((s = A.get("--popcount", "ripple")) != "ripple") {
+			if (s != "csa") throw "Unknown --popcount.";
+			opt.popcount = kmin_options::CSA_POPCOUNT, plain = false;
+		}
+		if ((s = A.get("--adder", "ripple")) != "ripple") {
+			if (s != "prefix") throw "Unknown --adder.";
+			opt.adder = kmin_options::PREFIX_ADDER, plain = false;
+		}
+		s = A.get("--topology", "kogge-stone");
+		if (s == "brent-kung") opt.topology = BRENT_KUNG;
+		else if (s == "sklansky") opt.topology = SKLANSKY;
+		else if (s != "kogge-stone") throw "Unknown --topology.";
+		if ((s = A.get("--comparator", "linear")) != "linear") {
+			if (s != "tree") throw "Unknown --comparator.";
+			opt.comparator = kmin_options::TREE_COMPARATOR, plain = false;
+		}
+		// the default construction is built directly as a netlist, which is much faster.
+		if (plain) return build_kmin(n, l);
+		return compiled_circuit(kmin_circuit(n, l, opt));
+	}
+	throw "Unknown circuit.";
+}
+
+static const char* _usage =
+	"usage: kmc <circuit> [options]\n"
+	"circuits:\n"
+	"    kmin --n N --l L [--popcount ripple|csa] [--adder ripple|prefix]\n"
+	"         [--topology kogge-stone|brent-kung|sklansky] [--comparator linear|tree]\n"
+	"    adder | bitadder --n N | csa_bitadder --n N | int_adder --n N | exint_adder --n N\n"
+	"    prefix_adder --n N | compare --n N | less --n N | selector --n N\n"
+	"    load FILE\n"
+	"options:\n"
+	"    --input FILE     lane-packed input records, fanin words of 64 vectors each (default: stdin)\n"
+	"    --output FILE    output records, fanout words each (default: stdout)\n"
+	"    --engine simd|parallel|native    --threads T    --words W (records per batch)\n"
+	"    --save FILE      write the netlist and exit\n"
+	"    --info           print the circuit size and the throughput to stderr\n";
+
+int run_cli(int argc, char* argv[]) {
+	FILE* input(stdin), * output(stdout);
+	bool parsed(false); // the usage is only printed for errors in the command line
+	try {
+		if (argc < 2) throw "Missing circuit.";
+		std::string name(argv[1]), file;
+		if (std::find(std::begin(_circuit_names), std::end(_circuit_names), name) == std::end(_circuit_names)) {
+			throw "Unknown circuit.";
+		}
+		int i(2);
+		if (name == "load") {
+			if (argc < 3) throw "Missing netlist file.";
+			file = argv[i++];
+		}
+		_cli_args A;
+		for (; i != argc; ++i) {
+			std::string key(argv[i]);
+			if (key == "--info") A.opt[key] = "";
+			else if (key.compare(0, 2, "--") || i + 1 == argc) throw "Invalid option.";
+			else A.opt[key] = argv[++i];
+		}
+		parsed = true;
+		auto t0 = std::chrono::steady_clock::now();
+		compiled_circuit C(_generate(name, file, A));
+		auto t1 = std::chrono::steady_clock::now();
+		bool info(A.opt.count("--info"));
+		if (info) {
+			fprintf(stderr, "%s: %d gates, depth %d, fan-in %d, fan-out %d, built in %.3f s\n", name.c_str(), C.gate_count(),
+				C.depth(), C.fanin(), C.fanout(), std::chrono::duration<double>(t1 - t0).count());
+		}
+		if (A.opt.count("--save")) {
+			C.save(A.opt["--save"]);
+			return 0;
+		}
+		std::string e(A.get("--engine", "simd"));
+		stream_evaluator::engine_type engine;
+		if (e == "simd") engine = stream_evaluator::SIMD_ENGINE;
+		else if (e == "parallel") engine = stream_evaluator::PARALLEL_ENGINE;
+		else if (e == "native") engine = stream_evaluator::NATIVE_ENGINE;
+		else throw "Unknown --engine.";
+		stream_evaluator S(C, engine, A.number("--threads", 0), A.number("--words", 64));
+		if (A.opt.count("--input") && A.opt["--input"] != "-") {
+			input = fopen(A.opt["--input"].c_str(), "rb");
+			if (!input) throw "Cannot open the input file.";
+		}
+		if (A.opt.count("--output") && A.opt["--output"] != "-") {
+			output = fopen(A.opt["--output"].c_str(), "wb");
+			if (!output) throw "Cannot open the output file.";
+		}
+		t0 = std::chrono::steady_clock::now();
+		long long records = S.run(input, output);
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (info) {
+			fprintf(stderr, "%lld vectors in %.3f s, %.4g vectors/s, %.4g MB/s in\n", records * 64, sec, records * 64 / sec,
+				records * C.fanin() * 8 / sec / 1e6);
+		}
+	} catch (const char* e) {
+		fprintf(stderr, "kmc: %s\n%s", e, parsed ? "" : _usage);
+		if (input != stdin) fclose(input);
+		if (output != stdout) fclose(output);
+		return 1;
+	} catch (const std::exception& e) {
+		// e.g. std::bad_alloc for a circuit too big to build
+		fprintf(stderr, "kmc: %s\n", e.what());
+		if (input != stdin) fclose(input);
+		if (output != stdout) fclose(output);
+		return 1;
+	}
+	if (input != stdin) fclose(input);
+	if (output != stdout && fclose(output) != 0) {
+		fprintf(stderr, "kmc: Write error.\n");
+		return 1;
+	}
+	return 0;
+}
+
+void test_stream_eval() {
+	const int n(100), l(128), records(2000); // 128000 vectors
+	compiled_circuit C(build_kmin(n, l));
+	int fin(C.fanin()), fout(C.fanout());
+	std::vector<uint64_t> in(size_t(fin) * records);
+	for (auto& w : in) w = (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ rand();
+	FILE* input(tmpfile());
+	fwrite(in.data(), sizeof(uint64_t), in.size(), input);
+	bool wrong(false);
+	for (int e(0); e != 2; ++e) {
+		rewind(input);
+		FILE* output(tmpfile());
+		stream_evaluator S(C, e ? stream_evaluator::PARALLEL_ENGINE : stream_evaluator::SIMD_ENGINE);
+		auto t0 = std::chrono::steady_clock::now();
+		long long got = S.run(input, output);
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		// against one eval_batch over the whole input, in its own layout
+		std::vector<uint64_t> packed(in.size()), expected(size_t(fout) * records), out(expected.size());
+		for (int w(0); w != records; ++w) {
+			for (int j(0); j != fin; ++j) packed[size_t(j) * records + w] = in[size_t(w) * fin + j];
+		}
+		C.eval_batch(packed.data(), expected.data(), records);
+		rewind(output);
+		if (got != records || fread(out.data(), sizeof(uint64_t), out.size(), output) != out.size()) wrong = true;
+		for (int w(0); w != records; ++w) {
+			for (int j(0); j != fout; ++j) {
+				if (out[size_t(w) * fout + j] != expected[size_t(j) * records + w]) wrong = true;
+			}
+		}
+		fclose(output);
+		std::cout << (e ? "parallel" : "simd") << ": " << records * 64 / sec << " vectors/s, "
+			<< in.size() * 8 / sec / 1e6 << " MB/s in" << std::endl;
+	}
+	// a trailing incomplete record: whole words, then a part of a word (after a full record, or alone)
+	for (size_t bytes : { (fin + 1) * sizeof(uint64_t), fin * sizeof(uint64_t) + 7, size_t(7) }) {
+		FILE* cut(tmpfile()), * output(tmpfile());
+		fwrite(in.data(), 1, bytes, cut);
+		rewind(cut);
+		stream_evaluator S(C);
+		try {
+			S.run(cut, output);
+			std::cout << bytes << " bytes of input: accepted." << std::endl;
+			wrong = true;
+		} catch (const char*) {
+		}
+		fclose(cut);
+		fclose(output);
+	}
+	fclose(input);
+	if (wrong) std::cout << "test_stream_eval: wrong." << std::endl;
+	else std::cout << "test_stream_eval: passed." << std::endl;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "compiled_circuit.h"
+#include "parallel_eval.h"
+#include "native_circuit.h"
+
+#include <cstdio>
+#include <memory>
+
+/*
+* Evaluate a stream of input vectors read from a file (or stdin), writing the outputs to another stream as it goes.
+*
+* The streams are sequences of records; a record is 64 vectors, lane-packed:
+*     input record:   uint64 word[fanin()]     bit b of word i is input i of the b-th vector
+*     output record:  uint64 word[fanout()]    likewise, one output record per input record
+* (native endianness). A trailing incomplete input record is an error.
+*
+* Reading, evaluating and writing run on their own threads, over a ring of buffers of `words` records each:
+* while one batch is evaluated, the next one is being read and the previous one written.
+*/
+class stream_evaluator {
+public:
+	enum engine_type {
+		SIMD_ENGINE,        // compiled_circuit::eval_batch, on the calling thread
+		PARALLEL_ENGINE,    // parallel_evaluator, over the given number of threads
+		NATIVE_ENGINE       // native_circuit (builds the circuit with the system compiler first)
+	};
+
+	stream_evaluator(const compiled_circuit& C, engine_type engine = SIMD_ENGINE, int threads = 0, int words = 64);
+
+	stream_evaluator(const stream_evaluator&) = delete;
+	stream_evaluator& operator=(const stream_evaluator&) = delete;
+
+	/*
+	* Evaluate every record of input until end of file; it throws on a read / write error or an incomplete record.
+	* It returns the number of records evaluated.
+	*/
+	long long run(FILE* input, FILE* output);
+
+	int fanin() const;
+	int fanout() const;
+
+private:
+	void eval_batch(const uint64_t* input, uint64_t* output, int words);
+
+	compiled_circuit C;
+	engine_type engine;
+	int words;
+	std::unique_ptr<parallel_evaluator> parallel;
+	std::unique_ptr<native_circuit> native;
+};
+
+/*
+* The command line tool; main calls it when it is given arguments.
+*
+*     kmc <circuit> [options]
+*
+* <circuit> is one of
+*     kmin --n N --l L [--popcount ripple|csa] [--adder ripple|prefix] [--topology kogge-stone|brent-kung|sklansky]
+*          [--comparator linear|tree]
+*     adder | bitadder --n N | csa_bitadder --n N | int_adder --n N | exint_adder --n N | prefix_adder --n N
+*     compare --n N | less --n N | selector --n N
+*     load FILE             a netlist written by compiled_circuit::save
+* options:
+*     --input FILE          the input records (default: stdin)
+*     --output FILE         the output records (default: stdout)
+*     --engine simd|parallel|native, --threads T, --words W    see stream_evaluator
+*     --save FILE           write the netlist to FILE and exit instead of evaluating
+*     --info                print the size of the circuit and the throughput to stderr
+*
+* It returns the exit code: 0 on success, 1 (with a message on stderr) otherwise.
+*/
+int run_cli(int argc, char* argv[]);
+
+void test_stream_eval();
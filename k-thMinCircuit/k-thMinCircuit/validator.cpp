@@ -0,0 +1,299 @@
+#include "validator.h"
+#include "netlist_builder.h"
+#include "kmin_circuit.h"
+
+#include <chrono>
+
+bool validation_report::ok() const {
+	return errors() == 0;
+}
+
+int validation_report::errors() const {
+	int ret(0);
+	for (const diagnostic& d : issues) {
+		if (d.severity == diagnostic::ERROR) ++ret;
+	}
+	return ret;
+}
+
+void validation_report::print(std::ostream& stream) const {
+	for (const diagnostic& d : issues) {
+		stream << (d.severity == diagnostic::ERROR ? "error: " : "warning: ");
+		if (d.gate >= 0) stream << "gate " << d.gate << ": ";
+		stream << d.message << std::endl;
+	}
+}
+
+static void _report(validation_report& R, diagnostic::kind_type kind, int g, const char* message) {
+	R.issues.push_back({ kind == diagnostic::UNUSED_INPUT ? diagnostic::WARNING : diagnostic::ERROR, kind, g, message });
+}
+
+/*
+* The checks shared by both versions; a reference out of range has already been replaced by -1 and reported.
+*/
+static void _validate(validation_report& R, const unsigned char* type, const int* in0, const int* in1, const int* in2, int n,
+	int fanin, const int* out, int fanout) {
+	R.gates = n;
+	std::vector<int> indeg(n, 0), fanout_begin(n + 1, 0);
+	for (int g(0); g != n; ++g) {
+		int a(in0[g]), b(in1[g]), c(in2[g]);
+		if (type[g] >= gate::END_OF_TYPE) {
+			_report(R, diagnostic::UNKNOWN_TYPE, g, "Unknown gate.");
+		} else {
+			if (type[g] == gate::INPUT) {
+				if (g >= fanin) _report(R, diagnostic::BAD_INPUT, g, "INPUT gate is not an input of the circuit.");
+			} else if (g < fanin) {
+				_report(R, diagnostic::BAD_INPUT, g, "Input gate is not of type INPUT.");
+			}
+			// exactly the first arity wires are connected.
+			int arity(gate::arity(gate::gate_type(type[g])));
+			if ((a >= 0) != (arity > 0) || (b >= 0) != (arity > 1) || (c >= 0) != (arity > 2)) {
+				switch (type[g]) {
+				case gate::INPUT:
+					_report(R, diagnostic::BAD_ARITY, g, "INPUT gate should have no input.");
+					break;
+				case gate::ZERO:
+				case gate::ONE:
+					_report(R, diagnostic::BAD_ARITY, g, "Constant gate should have no input.");
+					break;
+				case gate::NOT:
+					_report(R, diagnostic::BAD_ARITY, g, "NOT gate should have only one input.");
+					break;
+				default:
+					_report(R, diagnostic::BAD_ARITY, g, "Input gate missing.");
+					break;
+				}
+			}
+		}
+		for (int i : { a, b, c }) {
+			if (i < 0) continue;
+			++indeg[g];
+			++fanout_begin[i + 1];
+		}
+	}
+	for (int j(0); j != fanout; ++j) {
+		if (out[j] < 0 || out[j] >= n) _report(R, diagnostic::BAD_OUTPUT, -1, "Output gate missing.");
+	}
+
+	// fan-out in CSR form
+	for (int g(0); g != n; ++g) fanout_begin[g + 1] += fanout_begin[g];
+	std::vector<int> fanout_list(fanout_begin[n]), pos(fanout_begin.begin(), fanout_begin.end() - 1);
+	for (int g(0); g != n; ++g) {
+		for (int i : { in0[g], in1[g], in2[g] }) {
+			if (i >= 0) fanout_list[pos[i]++] = g;
+		}
+	}
+	std::vector<char> used(n, 0);
+	for (int j(0); j != fanout; ++j) {
+		if (out[j] >= 0 && out[j] < n) used[out[j]] = 1;
+	}
+	for (int g(0); g != fanin && g != n; ++g) {
+		if (type[g] == gate::INPUT && fanout_begin[g] == fanout_begin[g + 1] && !used[g]) {
+			_report(R, diagnostic::UNUSED_INPUT, g, "Input gate not used.");
+		}
+	}
+
+	// Topological sort (Kahn); what is left is on a cycle, or fed by one.
+	std::vector<int> queue;
+	for (int g(0); g != n; ++g) {
+		if (indeg[g] == 0) queue.push_back(g);
+	}
+	for (int head(0); head != queue.size(); ++head) {
+		int g(queue[head]);
+		for (int e(fanout_begin[g]); e != fanout_begin[g + 1]; ++e) {
+			if (--indeg[fanout_list[e]] == 0) queue.push_back(fanout_list[e]);
+		}
+	}
+	if (queue.size() == n) return;
+	// Trim the rest backwards: drop the gates none of whose consumers are left.
+	std::vector<int> outdeg(n, 0);
+	queue.clear();
+	for (int g(0); g != n; ++g) {
+		if (indeg[g] == 0) continue;
+		for (int e(fanout_begin[g]); e != fanout_begin[g + 1]; ++e) {
+			if (indeg[fanout_list[e]] > 0) ++outdeg[g];
+		}
+		if (outdeg[g] == 0) queue.push_back(g);
+	}
+	for (int head(0); head != queue.size(); ++head) {
+		int g(queue[head]);
+		indeg[g] = 0;
+		for (int i : { in0[g], in1[g], in2[g] }) {
+			if (i >= 0 && indeg[i] > 0 && --outdeg[i] == 0) queue.push_back(i);
+		}
+	}
+	for (int g(0); g != n; ++g) {
+		if (indeg[g] > 0) _report(R, diagnostic::CYCLE, g, "Gate on a combinational cycle.");
+	}
+}
+
+validation_report validate(const unsigned char* type, const int* in0, const int* in1, const int* in2, int ngate, int fanin,
+	const int* out, int fanout) {
+	validation_report R;
+	// references out of range are reported here, and read as not connected afterwards.
+	std::vector<int> a(in0, in0 + ngate), b(in1, in1 + ngate), c(in2, in2 + ngate);
+	for (int g(0); g != ngate; ++g) {
+		for (int* i : { &a[g], &b[g], &c[g] }) {
+			if (*i < -1 || *i >= ngate) {
+				_report(R, diagnostic::BAD_REFERENCE, g, "Input wire out of range.");
+				*i = -1;
+			}
+		}
+	}
+	_validate(R, type, a.data(), b.data(), c.data(), ngate, fanin, out, fanout);
+	return R;
+}
+
+validation_report validate(const compiled_circuit& C) {
+	return validate(C.type.data(), C.in0.data(), C.in1.data(), C.in2.data(), C.gate_count(), C.fanin(), C.out.data(), C.fanout());
+}
+
+validation_report validate(const circuit& C) {
+	validation_report R;
+	// Number the gates: first those reachable from the roots, then those only reachable backwards (e.g. from an output).
+	std::vector<gate*> order(C.roots());
+	for (int i(0); i != order.size(); ++i) order[i]->id = i;
+	auto visit = [&order](gate* g) {
+		if (g != nullptr && g->id < 0) {
+			g->id = order.size();
+			order.push_back(g);
+		}
+	};
+	int reachable(0);
+	for (int pass(0); pass != 2; ++pass) {
+		for (int head(0); head != order.size(); ++head) {
+			for (gate* g : order[head]->output) visit(g);
+			if (pass == 1) {
+				for (gate* i : order[head]->input) visit(i);
+			}
+		}
+		if (pass == 0) {
+			reachable = order.size();
+			for (gate* g : C.out) visit(g);
+		}
+	}
+	int n(order.size());
+	std::vector<unsigned char> type(n);
+	std::vector<int> in0(n, -1), in1(n, -1), in2(n, -1), out, links(n, 0);
+	for (int g(0); g != n; ++g) {
+		const gate* now(order[g]);
+		type[g] = now->type < 0 || now->type >= gate::END_OF_TYPE ? gate::END_OF_TYPE : now->type;
+		if (now->input[0]) in0[g] = now->input[0]->id;
+		if (now->input[1]) in1[g] = now->input[1]->id;
+		if (now->input[2]) in2[g] = now->input[2]->id;
+		for (const gate* c : now->output) {
+			if (c == nullptr) {
+				_report(R, diagnostic::BAD_REFERENCE, g, "Null pointer in the output vector.");
+				continue;
+			}
+			if (c->input[0] != now && c->input[1] != now && c->input[2] != now) {
+				_report(R, diagnostic::BAD_BACKLINK, c->id, "A gate is listed as output by a gate it does not read.");
+			} else {
+				++links[c->id];
+			}
+		}
+	}
+	for (int g(0); g != n; ++g) {
+		int expected((in0[g] >= 0) + (in1[g] >= 0) + (in2[g] >= 0));
+		if (links[g] < expected) _report(R, diagnostic::BAD_BACKLINK, g, "A gate is not marked as output by its input gate.");
+	}
+	for (int i(0); i != C.in.size(); ++i) {
+		if (C.in[i]->type != gate::INPUT) _report(R, diagnostic::BAD_INPUT, i, "Input gate is not of type INPUT.");
+	}
+	for (const gate* g : C.out) {
+		if (g == nullptr) _report(R, diagnostic::BAD_OUTPUT, -1, "Output gate missing.");
+		else if (g->id >= reachable) _report(R, diagnostic::BAD_OUTPUT, g->id, "Output gate not reachable from input.");
+		else out.push_back(g->id);
+	}
+	for (gate* g : order) g->id = -1;
+	_validate(R, type.data(), in0.data(), in1.data(), in2.data(), n, C.in.size(), out.data(), out.size());
+	return R;
+}
+
+/*
+* Circuits broken on purpose; the constructor of circuit is protected.
+*/
+class _broken_circuit :
+	public circuit
+{
+public:
+	_broken_circuit(int kind)
+		: circuit(2, 1)
+	{
+		gate* a(new_gate(gate::AND)), * b(new_gate(gate::OR)), * c(new_gate(gate::XOR));
+		switch (kind) {
+		case 0:
+			// a = in0 AND b, b = a OR in1: a cycle; c = b XOR in1 is only fed by it.
+			a->concat(in[0]);
+			b->concat(a, in[1]);
+			a->concat(b);
+			c->concat(b, in[1]);
+			out[0] = c;
+			break;
+		case 1:
+			// a misses an input; the backlink of b is broken; in1 is unused.
+			a->concat(in[0]);
+			b->concat(in[0], a);
+			in[0]->output.pop_back();
+			out[0] = b;
+			break;
+		default:
+			out[0] = nullptr;
+			break;
+		}
+	}
+};
+
+void test_validator() {
+	bool wrong(false);
+	for (int kind(0); kind != 3; ++kind) {
+		_broken_circuit C(kind);
+		validation_report R(validate(C));
+		std::cout << "broken circuit " << kind << ":" << std::endl;
+		R.print(std::cout);
+		int count[diagnostic::END_OF_KIND] = {};
+		for (auto& d : R.issues) ++count[d.kind];
+		if (kind == 0 && count[diagnostic::CYCLE] != 2) wrong = true;
+		if (kind == 1 && (!count[diagnostic::BAD_ARITY] || !count[diagnostic::BAD_BACKLINK] || !count[diagnostic::UNUSED_INPUT])) wrong = true;
+		if (kind == 2 && !count[diagnostic::BAD_OUTPUT]) wrong = true;
+		bool thrown(false);
+		try {
+			C.check();
+		} catch (const char*) {
+			thrown = true;
+		}
+		if (!thrown) wrong = true;
+	}
+	{
+		// arrays: 3 = AND(0, 4), 4 = NOT(3) is a cycle; 5 reads gate 9, which does not exist.
+		unsigned char type[] = { gate::INPUT, gate::INPUT, gate::INPUT, gate::AND, gate::NOT, gate::OR };
+		int in0[] = { -1, -1, -1, 0, 3, 1 }, in1[] = { -1, -1, -1, 4, -1, 9 }, in2[] = { -1, -1, -1, -1, -1, -1 }, out[] = { 5 };
+		validation_report R(validate(type, in0, in1, in2, 6, 3, out, 1));
+		std::cout << "broken netlist:" << std::endl;
+		R.print(std::cout);
+		if (R.errors() != 4) wrong = true; // a cycle of 2, a reference out of range and the arity of 5
+	}
+	{
+		const int n(1000), l(256);
+		auto t0 = std::chrono::steady_clock::now();
+		compiled_circuit K(build_kmin(n, l));
+		auto t1 = std::chrono::steady_clock::now();
+		validation_report R(validate(K));
+		auto t2 = std::chrono::steady_clock::now();
+		std::cout << "kmin(" << n << ", " << l << "): " << K.gate_count() << " gates, built in " << std::chrono::duration<double>(t1 - t0).count()
+			<< " s, validated in " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+		if (!R.ok()) wrong = true;
+	}
+	{
+		const int n(1000), l(32);
+		kmin_circuit C(n, l);
+		auto t0 = std::chrono::steady_clock::now();
+		validation_report R(validate(C));
+		auto t1 = std::chrono::steady_clock::now();
+		std::cout << "kmin_circuit(" << n << ", " << l << "): " << R.gates << " gates, validated in "
+			<< std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+		if (!R.ok()) wrong = true;
+	}
+	if (wrong) std::cout << "test_validator: wrong." << std::endl;
+	else std::cout << "test_validator: passed." << std::endl;
+}
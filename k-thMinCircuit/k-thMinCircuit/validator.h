@@ -0,0 +1,67 @@
+#pragma once
+#include "circuit.h"
+#include "compiled_circuit.h"
+
+#include <vector>
+#include <iostream>
+
+/*
+* One violation found by validate. gate is the index of the gate concerned, or -1 if it is about the circuit as a whole.
+* For a circuit, gates are numbered in breadth-first order from roots() (so the i-th input is gate i);
+* for arrays, gate i is entry i of the arrays.
+*/
+struct diagnostic {
+	enum severity_type { ERROR, WARNING };
+	enum kind_type {
+		UNKNOWN_TYPE,      // the type is not one of gate::gate_type
+		BAD_ARITY,         // input wires missing, or connected where there should be none
+		BAD_INPUT,         // an entry of in is not an INPUT gate, or an INPUT gate is not in in
+		BAD_REFERENCE,     // a wire refers to a null pointer or an index out of range
+		BAD_BACKLINK,      // input[] and output vectors do not agree
+		CYCLE,             // the gate is on a combinational cycle
+		BAD_OUTPUT,        // an output is null / out of range, or not reachable from the inputs
+		UNUSED_INPUT,      // an INPUT gate without consumer (warning)
+		END_OF_KIND
+	};
+	severity_type severity;
+	kind_type kind;
+	int gate;
+	const char* message;
+};
+
+/*
+* The result of validate: every violation found, errors and warnings.
+*/
+struct validation_report {
+	std::vector<diagnostic> issues;
+	int gates = 0;
+
+	/*
+	* No error (there may be warnings).
+	*/
+	bool ok() const;
+	int errors() const;
+
+	/*
+	* One line per issue: "error: gate 12: ...".
+	*/
+	void print(std::ostream& stream) const;
+};
+
+/*
+* Validate a circuit in O(V + E): the arity of every gate, the input / output links, the inputs and outputs,
+* and combinational cycles (by a topological sort: the gates it cannot order, trimmed of those merely fed by
+* a cycle, are reported as on a cycle). Unlike circuit::check, it does not stop at the first violation.
+*/
+validation_report validate(const circuit& C);
+
+/*
+* Validate a flat netlist given as arrays (see compiled_circuit; the gates need not be sorted):
+* gates [0, fanin) must be the INPUT gates, in0 / in1 / in2 are input indices (-1 if not connected).
+*/
+validation_report validate(const unsigned char* type, const int* in0, const int* in1, const int* in2, int ngate, int fanin,
+	const int* out, int fanout);
+
+validation_report validate(const compiled_circuit& C);
+
+void test_validator();